@@ -0,0 +1,239 @@
+#include "affinity.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+static const char *kStageNames[] = {"capture", "preprocess", "inference", "postprocess", "writer"};
+
+// CPU sets pthread_setaffinity_np refused, with the reason
+static mutex g_pinMutex;
+static map<vector<int>, string> g_pinFailures;
+
+const char *stageName(Stage s)
+{
+    return kStageNames[(int)s];
+}
+
+bool ThreadLayout::pinned() const
+{
+    for (const auto &c : cpus)
+        if (!c.empty())
+            return true;
+    return false;
+}
+
+// Parse a kernel-style cpulist ("0-3,8")
+static bool parseRanges(const string &spec, vector<int> &out)
+{
+    set<int> ids;
+    stringstream ss(spec);
+    string tok;
+    while (getline(ss, tok, ','))
+    {
+        if (tok.empty())
+            continue;
+        try
+        {
+            size_t dash = tok.find('-');
+            int a = stoi(tok.substr(0, dash));
+            int b = (dash == string::npos) ? a : stoi(tok.substr(dash + 1));
+            if (a < 0 || b < a)
+                return false;
+            for (int i = a; i <= b; ++i)
+                ids.insert(i);
+        }
+        catch (...)
+        {
+            return false;
+        }
+    }
+    out.assign(ids.begin(), ids.end());
+    return !out.empty();
+}
+
+static string readFirstLine(const string &path)
+{
+    ifstream ifs(path);
+    string line;
+    getline(ifs, line);
+    return line;
+}
+
+bool parseCpuList(const string &spec, vector<int> &cpus)
+{
+    if (spec.rfind("node", 0) == 0)
+    {
+        string list = readFirstLine("/sys/devices/system/node/" + spec + "/cpulist");
+        return !list.empty() && parseRanges(list, cpus);
+    }
+    return parseRanges(spec, cpus);
+}
+
+bool parsePinSpec(const string &spec, ThreadLayout &layout)
+{
+    size_t eq = spec.find('=');
+    if (eq == string::npos)
+        return false;
+    string stage = spec.substr(0, eq);
+    for (int s = 0; s < (int)Stage::Count; ++s)
+        if (stage == kStageNames[s])
+            return parseCpuList(spec.substr(eq + 1), layout.cpus[s]);
+    return false;
+}
+
+vector<int> onlineCpus()
+{
+    vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+        for (int i = 0; i < CPU_SETSIZE; ++i)
+            if (CPU_ISSET(i, &set))
+                cpus.push_back(i);
+#endif
+    if (cpus.empty())
+        parseRanges(readFirstLine("/sys/devices/system/cpu/online"), cpus);
+    return cpus;
+}
+
+vector<int> numaNodesOf(const vector<int> &cpus)
+{
+    set<int> nodes;
+    for (int node = 0;; ++node)
+    {
+        string list = readFirstLine("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+        vector<int> nodeCpus;
+        if (list.empty() || !parseRanges(list, nodeCpus))
+            break;
+        for (int c : cpus)
+            if (binary_search(nodeCpus.begin(), nodeCpus.end(), c))
+                nodes.insert(node);
+    }
+    return vector<int>(nodes.begin(), nodes.end());
+}
+
+string formatCpuList(const vector<int> &cpus)
+{
+    if (cpus.empty())
+        return "any";
+    ostringstream oss;
+    for (size_t i = 0; i < cpus.size();)
+    {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+            ++j;
+        oss << (i ? "," : "") << cpus[i];
+        if (j > i)
+            oss << "-" << cpus[j];
+        i = j + 1;
+    }
+    return oss.str();
+}
+
+void finalizeLayout(ThreadLayout &layout)
+{
+    if (!layout.pinned())
+        return;
+
+    vector<int> rest = onlineCpus();
+    const vector<int> &infer = layout[Stage::Inference];
+    if (layout.isolateInference && !infer.empty())
+    {
+        auto isInfer = [&](int c)
+        { return binary_search(infer.begin(), infer.end(), c); };
+        rest.erase(remove_if(rest.begin(), rest.end(), isInfer), rest.end());
+        for (int s = 0; s < (int)Stage::Count; ++s)
+        {
+            if (s == (int)Stage::Inference)
+                continue;
+            auto &c = layout.cpus[s];
+            c.erase(remove_if(c.begin(), c.end(), isInfer), c.end());
+        }
+    }
+    for (auto &c : layout.cpus)
+        if (c.empty())
+            c = rest;
+}
+
+void printLayout(const ThreadLayout &layout, int cvThreads, ostream &os)
+{
+    const vector<int> allowed = onlineCpus();
+    map<vector<int>, string> failures;
+    {
+        lock_guard<mutex> lk(g_pinMutex);
+        failures = g_pinFailures;
+    }
+
+    os << "Thread layout (OpenCV threads: " << cvThreads << ")\n";
+    for (int s = 0; s < (int)Stage::Count; ++s)
+    {
+        const vector<int> &cpus = layout.cpus[s];
+        vector<int> nodes = numaNodesOf(cpus);
+        os << "  " << kStageNames[s] << string(12 - string(kStageNames[s]).size(), ' ')
+           << "cpus " << formatCpuList(cpus);
+        if (!cpus.empty() && !nodes.empty())
+        {
+            os << "  numa ";
+            for (size_t i = 0; i < nodes.size(); ++i)
+                os << (i ? "," : "") << nodes[i];
+            if (nodes.size() > 1)
+                os << "  (warning: spans NUMA nodes)";
+        }
+        vector<int> outside;
+        for (int c : cpus)
+            if (!binary_search(allowed.begin(), allowed.end(), c))
+                outside.push_back(c);
+        auto failed = failures.find(cpus);
+        if (failed != failures.end())
+            os << "  (warning: pinning failed: " << failed->second << ")";
+        else if (!outside.empty())
+            os << "  (warning: cpus " << formatCpuList(outside) << " not available to this process)";
+        os << "\n";
+    }
+    if (layout.isolateInference)
+        os << "  inference cores isolated from other stages\n";
+}
+
+bool pinCurrentThread(const vector<int> &cpus)
+{
+    if (cpus.empty())
+        return true;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c : cpus)
+        if (c < CPU_SETSIZE)
+            CPU_SET(c, &set);
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc == 0)
+        return true;
+    const string reason = strerror(rc);
+#else
+    const string reason = "not supported on this platform";
+#endif
+    lock_guard<mutex> lk(g_pinMutex);
+    g_pinFailures.emplace(cpus, reason);
+    return false;
+}
+
+void StagePinner::enter(Stage s)
+{
+    const vector<int> &next = layout_[s];
+    if (next.empty() || (current_ && *current_ == next))
+        return;
+    pinCurrentThread(next); // a refused set is recorded there, not retried every frame
+    current_ = &next;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// ======================= Thread layout =======================
+// Pipeline stages that can be pinned to their own cores / NUMA nodes.
+enum class Stage
+{
+    Capture,
+    Preprocess,
+    Inference,
+    Postprocess,
+    Writer,
+    Count
+};
+
+const char *stageName(Stage s);
+
+struct ThreadLayout
+{
+    int cvThreads = -1;                          // cv::setNumThreads; -1 = auto
+    bool isolateInference = false;               // keep other stages off inference cores
+    std::vector<int> cpus[(int)Stage::Count];    // empty = not pinned
+    std::vector<int> &operator[](Stage s) { return cpus[(int)s]; }
+    const std::vector<int> &operator[](Stage s) const { return cpus[(int)s]; }
+    bool pinned() const;
+};
+
+// "0-3,8,10-11" or "node1" (all CPUs of that NUMA node)
+bool parseCpuList(const std::string &spec, std::vector<int> &cpus);
+// "inference=4-7", "capture=node0", ...
+bool parsePinSpec(const std::string &spec, ThreadLayout &layout);
+
+// CPUs this process may run on (its affinity mask, e.g. under taskset or a
+// cgroup cpuset); falls back to all online CPUs
+std::vector<int> onlineCpus();
+std::vector<int> numaNodesOf(const std::vector<int> &cpus);
+std::string formatCpuList(const std::vector<int> &cpus);
+
+// Resolve isolation and give unpinned stages a concrete set once anything is
+// pinned, so switching stages on the main thread always lands somewhere sane.
+void finalizeLayout(ThreadLayout &layout);
+// Also flags CPUs outside the process mask and sets a pin attempt failed on
+void printLayout(const ThreadLayout &layout, int cvThreads, std::ostream &os);
+
+// Failures are remembered (per CPU set) for printLayout
+bool pinCurrentThread(const std::vector<int> &cpus);
+
+// Moves the calling thread between stage CPU sets; no syscall when the next
+// stage shares the current set (or nothing is pinned).
+class StagePinner
+{
+public:
+    explicit StagePinner(const ThreadLayout &layout) : layout_(layout) {}
+    void enter(Stage s);
+
+private:
+    const ThreadLayout &layout_;
+    const std::vector<int> *current_ = nullptr;
+};
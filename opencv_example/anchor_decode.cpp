@@ -0,0 +1,319 @@
+#include "anchor_decode.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+using namespace cv;
+using namespace std;
+
+AnchorHeadConfig defaultAnchorConfig()
+{
+    AnchorHeadConfig c;
+    c.strides = {8, 16, 32};
+    c.anchors = {
+        {Size2f(10, 13), Size2f(16, 30), Size2f(33, 23)},
+        {Size2f(30, 61), Size2f(62, 45), Size2f(59, 119)},
+        {Size2f(116, 90), Size2f(156, 198), Size2f(373, 326)},
+    };
+    return c;
+}
+
+// All numbers on a line, ignoring brackets/commas and anything after '#'
+static vector<float> numbersIn(const string &line)
+{
+    vector<float> v;
+    const char *p = line.c_str();
+    while (*p && *p != '#')
+    {
+        if (isdigit((unsigned char)*p) || ((*p == '-' || *p == '.') && isdigit((unsigned char)p[1])))
+        {
+            char *end = nullptr;
+            v.push_back(strtof(p, &end));
+            p = end;
+        }
+        else
+            ++p;
+    }
+    return v;
+}
+
+AnchorHeadConfig loadAnchorConfig(const string &path)
+{
+    ifstream ifs(path);
+    if (!ifs.is_open())
+        throw runtime_error("Could not open anchors file: " + path);
+
+    AnchorHeadConfig c;
+    string l;
+    bool inAnchors = false;
+    while (getline(ifs, l))
+    {
+        size_t b = l.find_first_not_of(" \t\r");
+        if (b == string::npos || l[b] == '#')
+            continue;
+        bool topLevel = (b == 0 && l[0] != '-');
+        if (topLevel)
+            inAnchors = false;
+
+        if (l.compare(b, 8, "strides:") == 0)
+        {
+            for (float s : numbersIn(l.substr(b + 8)))
+                c.strides.push_back((int)s);
+        }
+        else if (l.compare(b, 8, "anchors:") == 0)
+            inAnchors = true;
+        else if (inAnchors && l[b] == '-')
+        {
+            vector<float> v = numbersIn(l.substr(b + 1));
+            if (v.empty() || v.size() % 2)
+                throw runtime_error("Bad anchors row in " + path + ": " + l);
+            vector<Size2f> row;
+            for (size_t i = 0; i < v.size(); i += 2)
+                row.push_back(Size2f(v[i], v[i + 1]));
+            c.anchors.push_back(row);
+        }
+    }
+    if (c.anchors.empty())
+        throw runtime_error("No anchors found in " + path);
+    if (!c.strides.empty() && c.strides.size() != c.anchors.size())
+        throw runtime_error("strides/anchors count mismatch in " + path);
+
+    // Heads are matched finest-first; keep each anchor row with its stride
+    if (!c.strides.empty())
+    {
+        vector<size_t> order(c.strides.size());
+        iota(order.begin(), order.end(), 0);
+        stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+                    { return c.strides[a] < c.strides[b]; });
+        AnchorHeadConfig sorted;
+        for (size_t i : order)
+        {
+            sorted.strides.push_back(c.strides[i]);
+            sorted.anchors.push_back(c.anchors[i]);
+        }
+        c = sorted;
+    }
+    return c;
+}
+
+bool isRawHeadOutput(const vector<Mat> &outs)
+{
+    int heads = 0;
+    for (const Mat &o : outs)
+    {
+        if (o.dims <= 3)
+            return false; // a decoded detection tensor is present; use that
+        if (o.dims == 5)
+            return true;
+        heads += (o.dims == 4);
+    }
+    return heads >= 2;
+}
+
+// Heads finest-first so they line up with ascending strides / anchor rows
+static vector<const Mat *> headsFinestFirst(const vector<Mat> &outs)
+{
+    vector<const Mat *> heads;
+    for (const Mat &o : outs)
+        if (o.dims == 4 || o.dims == 5)
+            heads.push_back(&o);
+    // grid width is dim 3 in both layouts
+    sort(heads.begin(), heads.end(), [](const Mat *a, const Mat *b)
+         { return a->size[3] > b->size[3]; });
+    return heads;
+}
+
+bool checkAnchorHeads(const vector<Mat> &outs, const AnchorHeadConfig &cfg, string &err)
+{
+    vector<const Mat *> heads = headsFinestFirst(outs);
+    if (heads.size() != cfg.anchors.size())
+    {
+        err = format("model has %d raw output heads but the anchor config has %d scales",
+                     (int)heads.size(), (int)cfg.anchors.size());
+        return false;
+    }
+    for (size_t s = 0; s < heads.size(); ++s)
+    {
+        const Mat &o = *heads[s];
+        const int na = (int)cfg.anchors[s].size();
+        // (1, na, H, W, no) or (1, na*no, H, W), with no = 5 + classes
+        const int no = (o.dims == 5) ? (o.size[1] == na ? o.size[4] : 0) : (o.size[1] % na == 0 ? o.size[1] / na : 0);
+        if (o.type() != CV_32F || no <= 5)
+        {
+            string shape;
+            for (int i = 0; i < o.dims; ++i)
+                shape += (i ? "x" : "") + to_string(o.size[i]);
+            err = format("output head %d (%s) does not fit %d anchors of 5 + classes channels", (int)s,
+                         shape.c_str(), na);
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline float sigmoid(float x)
+{
+    return 1.f / (1.f + std::exp(-x));
+}
+
+namespace
+{
+// View of one head: element (anchor a, cell, channel c) lives at
+// data[a * aStep + cell * cellStep + c * cStep]
+struct HeadView
+{
+    const float *data = nullptr;
+    int na = 0, no = 0, gh = 0, gw = 0;
+    size_t aStep = 0, cellStep = 0, cStep = 0;
+};
+
+struct ScaleDets
+{
+    vector<Rect> boxes;
+    vector<float> scores;
+    vector<int> classIds;
+};
+} // namespace
+
+static HeadView viewOf(const Mat &o, int na)
+{
+    CV_Assert(o.type() == CV_32F && o.size[0] == 1);
+    HeadView h;
+    h.data = o.ptr<float>();
+    if (o.dims == 5) // (1, na, H, W, no): channels interleaved per cell
+    {
+        h.na = o.size[1];
+        h.gh = o.size[2];
+        h.gw = o.size[3];
+        h.no = o.size[4];
+        h.cStep = 1;
+        h.cellStep = h.no;
+        h.aStep = (size_t)h.gh * h.gw * h.no;
+    }
+    else // (1, na*no, H, W): channel planes
+    {
+        CV_Assert(o.dims == 4 && na > 0 && o.size[1] % na == 0);
+        h.na = na;
+        h.no = o.size[1] / na;
+        h.gh = o.size[2];
+        h.gw = o.size[3];
+        h.cellStep = 1;
+        h.cStep = (size_t)h.gh * h.gw;
+        h.aStep = h.cStep * h.no;
+    }
+    return h;
+}
+
+void decodeAnchorHeads(const vector<Mat> &outs, const AnchorHeadConfig &cfg, float confThr,
+                       vector<Rect> &boxes, vector<float> &scores, vector<int> &classIds,
+                       int imgW, int imgH, float scale, const Vec4i &pad, int inputW)
+{
+    boxes.clear();
+    scores.clear();
+    classIds.clear();
+
+    vector<const Mat *> heads = headsFinestFirst(outs);
+    if (heads.size() != cfg.anchors.size())
+        CV_Error(Error::StsBadArg, format("model has %d heads but anchor config has %d scales",
+                                          (int)heads.size(), (int)cfg.anchors.size()));
+
+    vector<HeadView> views;
+    vector<float> strides;
+    for (size_t s = 0; s < heads.size(); ++s)
+    {
+        HeadView v = viewOf(*heads[s], (int)cfg.anchors[s].size());
+        CV_Assert(v.na == (int)cfg.anchors[s].size() && v.no > 5);
+        views.push_back(v);
+        strides.push_back(cfg.strides.empty() ? (float)inputW / v.gw : (float)cfg.strides[s]);
+    }
+
+    // conf = sig(obj) * sig(cls) <= sig(obj): compare the raw logit instead
+    const float c = min(max(confThr, 1e-6f), 1.f - 1e-6f);
+    const float objLogitThr = std::log(c / (1.f - c));
+
+    // One task per (scale, anchor) keeps the fine 80x80 scale from
+    // dominating a single worker.
+    vector<pair<int, int>> tasks;
+    for (size_t s = 0; s < views.size(); ++s)
+        for (int a = 0; a < views[s].na; ++a)
+            tasks.push_back({(int)s, a});
+    vector<ScaleDets> partial(tasks.size());
+
+    auto decodeTasks = [&](const Range &r)
+    {
+        for (int t = r.start; t < r.end; ++t)
+        {
+            const int s = tasks[t].first, a = tasks[t].second;
+            const HeadView &v = views[s];
+            const float stride = strides[s];
+            const Size2f anchor = cfg.anchors[s][a];
+            const int nc = v.no - 5;
+            const float *base = v.data + a * v.aStep;
+            ScaleDets &out = partial[t];
+
+            for (int gy = 0; gy < v.gh; ++gy)
+                for (int gx = 0; gx < v.gw; ++gx)
+                {
+                    const float *q = base + (size_t)(gy * v.gw + gx) * v.cellStep;
+                    const float objLogit = q[4 * v.cStep];
+                    if (objLogit < objLogitThr)
+                        continue;
+
+                    // sigmoid is monotonic: pick the best class on logits
+                    int cls = 0;
+                    float best = -numeric_limits<float>::infinity();
+                    for (int k = 0; k < nc; ++k)
+                    {
+                        float l = q[(5 + k) * v.cStep];
+                        if (l > best)
+                        {
+                            best = l;
+                            cls = k;
+                        }
+                    }
+                    const float conf = sigmoid(objLogit) * sigmoid(best);
+                    if (conf < confThr)
+                        continue;
+
+                    // YOLOv5/v7 box parameterisation
+                    const float cx = (sigmoid(q[0]) * 2.f - 0.5f + gx) * stride;
+                    const float cy = (sigmoid(q[v.cStep]) * 2.f - 0.5f + gy) * stride;
+                    const float tw = sigmoid(q[2 * v.cStep]) * 2.f;
+                    const float th = sigmoid(q[3 * v.cStep]) * 2.f;
+                    const float w = tw * tw * anchor.width;
+                    const float h = th * th * anchor.height;
+
+                    // letterboxed input -> frame
+                    float x0 = (cx - w / 2.f - pad[0]) / scale;
+                    float y0 = (cy - h / 2.f - pad[1]) / scale;
+                    float x1 = (cx + w / 2.f - pad[0]) / scale;
+                    float y1 = (cy + h / 2.f - pad[1]) / scale;
+                    x0 = max(0.f, min(x0, (float)imgW - 1));
+                    y0 = max(0.f, min(y0, (float)imgH - 1));
+                    x1 = max(0.f, min(x1, (float)imgW));
+                    y1 = max(0.f, min(y1, (float)imgH));
+                    Rect box((int)std::round(x0), (int)std::round(y0),
+                             (int)std::round(x1 - x0), (int)std::round(y1 - y0));
+                    if (box.width <= 1 || box.height <= 1)
+                        continue;
+
+                    out.boxes.push_back(box);
+                    out.scores.push_back(conf);
+                    out.classIds.push_back(cls);
+                }
+        }
+    };
+    parallel_for_(Range(0, (int)tasks.size()), decodeTasks);
+
+    for (const ScaleDets &p : partial)
+    {
+        boxes.insert(boxes.end(), p.boxes.begin(), p.boxes.end());
+        scores.insert(scores.end(), p.scores.begin(), p.scores.end());
+        classIds.insert(classIds.end(), p.classIds.begin(), p.classIds.end());
+    }
+}
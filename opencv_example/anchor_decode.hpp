@@ -0,0 +1,44 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <string>
+#include <vector>
+
+// ======================= Raw anchor-based heads =======================
+// YOLOv5/v7 exported without the in-graph decode/concat: one tensor per
+// stride, either (1, na*(5+nc), H, W) or (1, na, H, W, 5+nc), raw logits.
+struct AnchorHeadConfig
+{
+    std::vector<int> strides;                        // per scale, ascending; empty = derive from grid
+    std::vector<std::vector<cv::Size2f>> anchors;    // per scale, in input pixels
+};
+
+// YOLOv5/v7 P3-P5 defaults (strides 8/16/32)
+AnchorHeadConfig defaultAnchorConfig();
+
+// Reads
+//   strides: [8, 16, 32]
+//   anchors:
+//     - [10,13, 16,30, 33,23]
+//     - [30,61, 62,45, 59,119]
+//     - [116,90, 156,198, 373,326]
+// (Ultralytics model yaml layout; other keys are ignored.) Anchor rows are
+// reordered along with the strides, finest first. Throws on error.
+AnchorHeadConfig loadAnchorConfig(const std::string &path);
+
+// True when the net's outputs are raw per-stride heads rather than a single
+// decoded (1, N, C) / (1, C, N) tensor.
+bool isRawHeadOutput(const std::vector<cv::Mat> &outs);
+
+// Whether raw heads match the config (one scale per head, anchors per scale
+// dividing the channels); meant for warm-up outputs, so a mismatch is
+// reported at startup instead of failing on the first frame.
+bool checkAnchorHeads(const std::vector<cv::Mat> &outs, const AnchorHeadConfig &cfg, std::string &err);
+
+// Decode all heads into frame-space boxes. Scales (and anchors within a
+// scale) are decoded in parallel; a cell's box/class channels are only
+// touched after its objectness logit clears the confidence threshold.
+void decodeAnchorHeads(const std::vector<cv::Mat> &outs, const AnchorHeadConfig &cfg, float confThr,
+                       std::vector<cv::Rect> &boxes, std::vector<float> &scores, std::vector<int> &classIds,
+                       int imgW, int imgH, float scale, const cv::Vec4i &pad, int inputW);
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// Small blocking FIFO used between pipeline threads. push() blocks while full,
+// pop() blocks while empty; close() wakes everyone and makes pop() drain then
+// fail, push() fail immediately.
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : cap_(capacity ? capacity : 1) {}
+
+    bool push(T v)
+    {
+        std::unique_lock<std::mutex> lk(m_);
+        notFull_.wait(lk, [&]
+                      { return closed_ || q_.size() < cap_; });
+        if (closed_)
+            return false;
+        q_.push_back(std::move(v));
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    bool pop(T &v)
+    {
+        std::unique_lock<std::mutex> lk(m_);
+        notEmpty_.wait(lk, [&]
+                       { return closed_ || !q_.empty(); });
+        if (q_.empty())
+            return false;
+        v = std::move(q_.front());
+        q_.pop_front();
+        notFull_.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        closed_ = true;
+        notFull_.notify_all();
+        notEmpty_.notify_all();
+    }
+
+private:
+    std::mutex m_;
+    std::condition_variable notFull_, notEmpty_;
+    std::deque<T> q_;
+    size_t cap_;
+    bool closed_ = false;
+};
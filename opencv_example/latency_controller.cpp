@@ -0,0 +1,105 @@
+#include "latency_controller.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+using namespace std;
+
+// Smoothing and hysteresis. Over budget for a few frames -> step down;
+// well under budget for a long stretch -> step up. A cooldown after every
+// change lets the EWMA catch up with the new level before judging again.
+static const double kAlpha = 0.1;
+static const int kDegradeAfter = 5;
+static const int kRecoverAfter = 60;
+static const double kRecoverHeadroom = 0.7;
+static const int kCooldown = 15;
+
+LatencyController::LatencyController(const ControllerBounds &b) : bounds_(b)
+{
+    // Ladder, cheapest quality loss first: tighter candidate cap, then smaller
+    // inputs, then skipping frames.
+    QualityLevel q;
+    q.detectEvery = max(1, b.baseDetectEvery);
+    q.maxCandidates = b.maxCandidates;
+    levels_.push_back(q);
+    if (b.minCandidates > 0 && (b.maxCandidates == 0 || b.minCandidates < b.maxCandidates))
+    {
+        q.maxCandidates = b.minCandidates;
+        levels_.push_back(q);
+    }
+    for (int s = 1; s < b.numSizes; ++s)
+    {
+        q.sizeIdx = s;
+        levels_.push_back(q);
+    }
+    for (int n = q.detectEvery + 1; n <= b.maxDetectEvery; ++n)
+    {
+        q.detectEvery = n;
+        levels_.push_back(q);
+    }
+}
+
+bool LatencyController::update(double latencyMs)
+{
+    if (!enabled())
+        return false;
+    ewmaMs_ = (ewmaMs_ == 0) ? latencyMs : (1 - kAlpha) * ewmaMs_ + kAlpha * latencyMs;
+    if (cooldown_ > 0)
+    {
+        --cooldown_;
+        return false;
+    }
+
+    overCount_ = (ewmaMs_ > bounds_.targetMs) ? overCount_ + 1 : 0;
+    underCount_ = (ewmaMs_ < bounds_.targetMs * kRecoverHeadroom) ? underCount_ + 1 : 0;
+
+    int next = cur_;
+    if (overCount_ >= kDegradeAfter && cur_ + 1 < (int)levels_.size())
+        next = cur_ + 1;
+    else if (underCount_ >= kRecoverAfter && cur_ > 0)
+        next = cur_ - 1;
+    if (next == cur_)
+        return false;
+
+    ostringstream oss;
+    oss << (next > cur_ ? "degrade" : "recover") << " (latency " << (int)ewmaMs_
+        << " ms, target " << (int)bounds_.targetMs << " ms)";
+    reason_ = oss.str();
+    cur_ = next;
+    overCount_ = underCount_ = 0;
+    cooldown_ = kCooldown;
+    return true;
+}
+
+ostream &operator<<(ostream &os, const QualityLevel &q)
+{
+    os << "size#" << q.sizeIdx << " every=" << q.detectEvery << " cand=";
+    if (q.maxCandidates > 0)
+        os << q.maxCandidates;
+    else
+        os << "all";
+    return os;
+}
+
+bool parseDurationMs(const string &s, double &ms)
+{
+    try
+    {
+        size_t n = 0;
+        double v = stod(s, &n);
+        string unit = s.substr(n);
+        if (unit.empty() || unit == "ms")
+            ms = v;
+        else if (unit == "s")
+            ms = v * 1000.0;
+        else if (unit == "us")
+            ms = v / 1000.0;
+        else
+            return false;
+        return ms > 0;
+    }
+    catch (...)
+    {
+        return false;
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// ======================= Latency SLO controller =======================
+// Walks a fixed ladder of quality levels (0 = best) to keep the smoothed
+// end-to-end latency under a target. Degrades quickly when over budget,
+// recovers slowly once there is clear headroom.
+struct QualityLevel
+{
+    int sizeIdx = 0;       // index into the pre-warmed input sizes (0 = largest)
+    int detectEvery = 1;   // run the net on every N-th frame
+    int maxCandidates = 0; // pre-NMS candidate cap, 0 = unlimited
+};
+
+struct ControllerBounds
+{
+    double targetMs = 0;     // 0 = controller disabled
+    int numSizes = 1;        // pre-warmed sizes, largest first
+    int baseDetectEvery = 1; // cadence at level 0 (--detect-every)
+    int maxDetectEvery = 3;  // upper bound for the cadence knob
+    int maxCandidates = 0;   // starting cap (0 = unlimited)
+    int minCandidates = 300;
+};
+
+class LatencyController
+{
+public:
+    explicit LatencyController(const ControllerBounds &b);
+
+    bool enabled() const { return bounds_.targetMs > 0; }
+    const QualityLevel &level() const { return levels_[cur_]; }
+    int levelIndex() const { return cur_; }
+    int numLevels() const { return (int)levels_.size(); }
+    double smoothedMs() const { return ewmaMs_; }
+
+    // Feed one frame's end-to-end latency; returns true if the level changed.
+    bool update(double latencyMs);
+
+    // Why the last change happened (for logging)
+    const std::string &lastReason() const { return reason_; }
+
+private:
+    ControllerBounds bounds_;
+    std::vector<QualityLevel> levels_;
+    int cur_ = 0;
+    double ewmaMs_ = 0;
+    int overCount_ = 0, underCount_ = 0, cooldown_ = 0;
+    std::string reason_;
+};
+
+std::ostream &operator<<(std::ostream &os, const QualityLevel &q);
+
+// "50ms", "50", "0.05s"
+bool parseDurationMs(const std::string &s, double &ms);
@@ -2,7 +2,32 @@
 #include <opencv2/dnn.hpp>
 #include <iostream>
 #include <fstream>
-#include <regex>
+#include <csignal>
+#include <thread>
+#include <future>
+#include <mutex>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "affinity.hpp"
+#include "anchor_decode.hpp"
+#include "bounded_queue.hpp"
+#include "latency_controller.hpp"
+#include "mjpeg_server.hpp"
+#include "segmented_reader.hpp"
+#include "shm_publisher.hpp"
+#include "trace.hpp"
+#include "zones.hpp"
+
+// G-API streaming engine (--engine gapi) needs the gapi module of OpenCV >= 4.6
+#if defined(HAVE_OPENCV_GAPI) && (CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 6))
+#define YOLO_WITH_GAPI
+#include <opencv2/gapi.hpp>
+#include <opencv2/gapi/cpu/gcpukernel.hpp>
+#include <opencv2/gapi/streaming/cap.hpp>
+#include <opencv2/gapi/streaming/format.hpp>
+#include <opencv2/gapi/streaming/meta.hpp>
+#endif
 
 using namespace cv;
 using namespace std;
@@ -15,11 +40,42 @@ struct YoloConfig
     string yamlPath;     // optional
     string namesPath;    // optional
     string savePath;     // optional video output
+    string rlePath;      // optional per-frame mask RLE output (JSON lines)
+    string anchorsPath;  // optional anchors/strides for raw multi-head models
+    string zonesPath;    // optional ROI polygons; inference is cropped to them
+    bool zoneBatch = false; // one batch entry per zone instead of their union
+    string shmName;         // optional shared-memory ring for local consumers
+    int shmSlots = 8;
+    bool shmAnnotated = false; // publish frames after drawing instead of raw
+    PreviewServer::Options http; // MJPEG preview (port 0 = off)
+    bool display = true;         // imshow window
+    string engine = "loop";      // "loop" (hand-written pipeline) or "gapi"
+    bool offline = false;        // video file: decode chunks in parallel, process every frame
+    SegmentedReader::Options decode;
+    string modelControl;         // optional hot-swap control file (model/size/classes)
+    string tracePath;            // optional Chrome trace JSON (dumped on exit and SIGUSR1)
+    size_t traceEvents = 65536;  // spans kept per thread
     int inputW = 640;
     int inputH = 640;
     float confThr = 0.25f;
     float iouThr = 0.45f;
+    float maskThr = 0.5f; // segmentation models only
     bool useCUDA = false;
+    ThreadLayout layout; // --threads / --pin / --isolate-inference
+    int detectEvery = 1;   // run the net every N-th frame, redraw last boxes in between
+    int maxCandidates = 0; // pre-NMS candidate cap, 0 = unlimited
+    // Latency SLO controller (off unless targetLatencyMs > 0)
+    double targetLatencyMs = 0;
+    vector<Size> adaptSizes; // extra, smaller, pre-warmed input sizes
+    int adaptMaxEvery = 3;
+    int adaptMinCandidates = 300;
+};
+
+struct CapturedFrame
+{
+    Mat image;
+    int64 captureTick = 0; // getTickCount() when grabbed, for end-to-end latency
+    long index = 0;        // capture order; the trace frame id in every stage
 };
 
 // ======================= Utils ========================
@@ -49,7 +105,35 @@ static vector<string> loadNamesFile(const string &path)
     return names;
 }
 
-// Parse Ultralytics-style coco.yaml (names list/map)
+static string unquote(const string &s)
+{
+    string v = trim(s);
+    if (!v.empty() && (v.front() == '\'' || v.front() == '"'))
+        v.erase(v.begin());
+    if (!v.empty() && (v.back() == '\'' || v.back() == '"'))
+        v.pop_back();
+    return v;
+}
+
+// "3: person" -> names[3] = "person"; false if `tok` isn't "<index>: value"
+static bool setIndexedName(vector<string> &names, const string &tok)
+{
+    size_t colon = tok.find(':');
+    if (colon == string::npos)
+        return false;
+    string key = trim(tok.substr(0, colon)), val = unquote(tok.substr(colon + 1));
+    if (key.empty() || val.empty() || key.find_first_not_of("0123456789") != string::npos || key.size() > 6)
+        return false;
+    size_t idx = (size_t)stoi(key);
+    if (names.size() <= idx)
+        names.resize(idx + 1);
+    names[idx] = val;
+    return true;
+}
+
+// Parse Ultralytics-style coco.yaml (names list/map) in a single pass:
+//   names: [a, b, c]      names: {0: a, 1: b}      names:
+//                                                    0: a     (or  - a)
 static vector<string> parseCocoYaml(const string &path)
 {
     if (path.empty())
@@ -57,131 +141,62 @@ static vector<string> parseCocoYaml(const string &path)
     ifstream ifs(path);
     if (!ifs.is_open())
         throw runtime_error("Could not open yaml: " + path);
-    vector<string> names;
-    string all;
-    {
-        ostringstream oss;
-        oss << ifs.rdbuf();
-        all = oss.str();
-    }
 
-    // Inline list: names: [a, b, c]
+    vector<string> names;
+    string line, flow; // flow: inline [..] / {..} body, may span lines
+    char flowEnd = 0;
+    bool inBlock = false;
+    while (getline(ifs, line))
     {
-        regex rx(R"(names\s*:\s*\[([^\]]*)\])");
-        smatch m;
-        if (regex_search(all, m, rx))
+        const string t = trim(line);
+        if (flowEnd)
+            flow += " " + t;
+        else if (inBlock)
         {
-            string inside = m[1].str(), cur;
-            for (char c : inside)
-            {
-                if (c == ',')
-                {
-                    cur = trim(cur);
-                    if (!cur.empty())
-                        names.push_back(cur);
-                    cur.clear();
-                }
-                else
-                    cur.push_back(c);
-            }
-            cur = trim(cur);
-            if (!cur.empty())
-                names.push_back(cur);
-            for (auto &s : names)
+            if (t.empty() || t[0] == '#')
+                continue;
+            if (!isspace((unsigned char)line[0]) && t[0] != '-' && t.find(':') != string::npos)
+                break; // next top-level key
+            if (t[0] == '-')
             {
-                if (!s.empty() && (s.front() == '\'' || s.front() == '"'))
-                    s.erase(s.begin());
-                if (!s.empty() && (s.back() == '\'' || s.back() == '"'))
-                    s.pop_back();
+                string val = unquote(t.substr(1));
+                if (!val.empty())
+                    names.push_back(val);
             }
-            if (!names.empty())
-                return names;
+            else
+                setIndexedName(names, t);
+            continue;
         }
-    }
-    // Inline map: names: {0: a, 1: b}
-    {
-        regex rx(R"(names\s*:\s*\{([^\}]*)\})");
-        smatch m;
-        if (regex_search(all, m, rx))
+        else
         {
-            string inside = m[1].str();
-            size_t start = 0;
-            while (true)
+            if (t.compare(0, 5, "names") != 0)
+                continue;
+            size_t colon = t.find_first_not_of(" \t", 5);
+            if (colon == string::npos || t[colon] != ':')
+                continue;
+            string rest = trim(t.substr(colon + 1));
+            if (rest.empty() || (rest[0] != '[' && rest[0] != '{'))
             {
-                size_t pos = inside.find(',', start);
-                string tok = trim(pos == string::npos ? inside.substr(start) : inside.substr(start, pos - start));
-                if (!tok.empty())
-                {
-                    size_t colon = tok.find(':');
-                    if (colon != string::npos)
-                    {
-                        int idx = stoi(trim(tok.substr(0, colon)));
-                        string val = trim(tok.substr(colon + 1));
-                        if (!val.empty() && (val.front() == '\'' || val.front() == '"'))
-                            val.erase(val.begin());
-                        if (!val.empty() && (val.back() == '\'' || val.back() == '"'))
-                            val.pop_back();
-                        if ((int)names.size() <= idx)
-                            names.resize(idx + 1);
-                        names[idx] = val;
-                    }
-                }
-                if (pos == string::npos)
-                    break;
-                start = pos + 1;
+                inBlock = rest.empty() || rest[0] == '#';
+                continue;
             }
-            if (!names.empty())
-                return names;
+            flowEnd = rest[0] == '[' ? ']' : '}';
+            flow = rest.substr(1);
         }
-    }
-    // Multiline after "names:"
-    {
-        istringstream iss(all);
-        string l;
-        bool inNames = false;
-        regex rx_idx(R"(^\s*([0-9]+)\s*:\s*(.+)\s*$)");
-        regex rx_li(R"(^\s*-\s*(.+)\s*$)");
-        while (getline(iss, l))
+
+        size_t end = flow.find(flowEnd);
+        if (end == string::npos)
+            continue; // list/map continues on the next line
+        stringstream ss(flow.substr(0, end));
+        string tok;
+        while (getline(ss, tok, ','))
         {
-            string t = trim(l);
-            if (!inNames)
-            {
-                if (t.rfind("names:", 0) == 0)
-                {
-                    inNames = true;
-                    continue;
-                }
-            }
-            else
-            {
-                if (t.empty() || t[0] == '#')
-                    continue;
-                if (!isspace(l[0]) && t.find(':') != string::npos && t.rfind("-", 0) != 0)
-                    break; // next top-level
-                smatch m;
-                if (regex_search(t, m, rx_idx))
-                {
-                    int idx = stoi(m[1].str());
-                    string val = trim(m[2].str());
-                    if (!val.empty() && (val.front() == '\'' || val.front() == '"'))
-                        val.erase(val.begin());
-                    if (!val.empty() && (val.back() == '\'' || val.back() == '"'))
-                        val.pop_back();
-                    if ((int)names.size() <= idx)
-                        names.resize(idx + 1);
-                    names[idx] = val;
-                }
-                else if (regex_search(t, m, rx_li))
-                {
-                    string val = trim(m[1].str());
-                    if (!val.empty() && (val.front() == '\'' || val.front() == '"'))
-                        val.erase(val.begin());
-                    if (!val.empty() && (val.back() == '\'' || val.back() == '"'))
-                        val.pop_back();
-                    names.push_back(val);
-                }
-            }
+            if (flowEnd == '}')
+                setIndexedName(names, tok);
+            else if (!unquote(tok).empty())
+                names.push_back(unquote(tok));
         }
+        break;
     }
     return names;
 }
@@ -299,16 +314,22 @@ static Mat makeDetRowsNxC(const Mat &out3d, int &C, int &N)
     }
 }
 
-// Robust decode with normalization + cxcywh/xyxy fallback + optional obj column
+// Robust decode with normalization + cxcywh/xyxy fallback + optional obj column.
+// For segmentation heads the last numMaskCoeffs columns are mask coefficients:
+// they are skipped for class scoring and, if maskCoeffs is given, copied out
+// (one row per returned box) so masks can be decoded after NMS.
 static void parseDetectionsRobust(
     const cv::Mat &out, float confThr,
     std::vector<cv::Rect> &boxes, std::vector<float> &scores, std::vector<int> &classIds,
     int imgW, int imgH, float scale, const cv::Vec4i &pad, int inputW, int inputH,
-    int expectedNumClasses, bool debug = false)
+    int expectedNumClasses, bool debug = false,
+    int numMaskCoeffs = 0, cv::Mat *maskCoeffs = nullptr)
 {
     boxes.clear();
     scores.clear();
     classIds.clear();
+    if (maskCoeffs)
+        maskCoeffs->release();
 
     Mat det;
     int C = 0, N = 0;
@@ -329,6 +350,10 @@ static void parseDetectionsRobust(
 
     if (debug)
         cerr << "[parse] Using (N×C) = (" << N << "×" << C << ")\n";
+
+    // Everything from here on sees only the box/obj/class part of each row
+    const int nm = max(0, numMaskCoeffs);
+    C -= nm;
     if (C < 6 || N <= 0)
     {
         if (debug)
@@ -440,125 +465,555 @@ static void parseDetectionsRobust(
         boxes.push_back(box);
         scores.push_back(conf);
         classIds.push_back(cls);
+        if (maskCoeffs && nm > 0)
+            maskCoeffs->push_back(Mat(1, nm, CV_32F, (void *)(p + C)));
     }
 }
 
-static void printHelp(const char *prog)
+// ---------------------- SEGMENTATION ----------------------
+// YOLO-seg exports two outputs: detections (1, 4+nc+nm, N) and prototypes
+// (1, nm, H/4, W/4). Pick them apart by rank; proto stays empty for
+// detection-only models.
+static void splitOutputs(const vector<Mat> &outs, Mat &det, Mat &proto)
 {
-    cout << "Usage:\n"
-            "  "
-         << prog << " <yolo11.onnx> [source]\n"
-                    "Options:\n"
-                    "  --yaml path        Load classes from coco.yaml\n"
-                    "  --names path       Load classes from .names file\n"
-                    "  --conf f           Confidence threshold (default 0.25)\n"
-                    "  --iou f            IoU threshold for NMS (default 0.45)\n"
-                    "  --size WxH         Inference size (default 640x640)\n"
-                    "  --save out.mp4     Save annotated video\n"
-                    "  --cuda             Use CUDA DNN backend (if available)\n";
+    det.release();
+    proto.release();
+    for (const Mat &o : outs)
+    {
+        if (o.dims == 4 && proto.empty())
+            proto = o;
+        else if (o.dims <= 3 && det.empty())
+            det = o;
+    }
 }
 
-static bool parseSize(const string &s, int &w, int &h)
+// Decode one instance mask, lazily: coefficients × prototypes and the sigmoid
+// are evaluated only on the prototype cells under `box`, then upsampled
+// straight into box-sized output. Returns a CV_8U (0/255) mask of box.size().
+static Mat decodeMask(const Mat &coeffs, const Mat &proto, const Rect &box,
+                      float scale, const Vec4i &pad, int inputW, int inputH, float maskThr)
 {
-    size_t x = s.find('x');
-    if (x == string::npos)
-        return false;
-    try
+    CV_Assert(proto.dims == 4 && proto.size[0] == 1 && proto.type() == CV_32F);
+    const int nm = proto.size[1], ph = proto.size[2], pw = proto.size[3];
+    CV_Assert(coeffs.type() == CV_32F && (int)coeffs.total() == nm);
+
+    // frame -> letterboxed input -> prototype grid (pure scale + offset)
+    const float sx = scale * pw / inputW, sy = scale * ph / inputH;
+    const float ox = pad[0] * (float)pw / inputW, oy = pad[1] * (float)ph / inputH;
+
+    int x0 = max(0, (int)floor(box.x * sx + ox));
+    int y0 = max(0, (int)floor(box.y * sy + oy));
+    int x1 = min(pw, (int)ceil((box.x + box.width) * sx + ox));
+    int y1 = min(ph, (int)ceil((box.y + box.height) * sy + oy));
+    if (x1 <= x0 || y1 <= y0)
+        return Mat::zeros(box.size(), CV_8U);
+
+    Mat soft(y1 - y0, x1 - x0, CV_32F, Scalar(0));
+    const float *c = coeffs.ptr<float>();
+    const size_t plane = (size_t)ph * pw;
+    for (int k = 0; k < nm; ++k)
     {
-        w = stoi(s.substr(0, x));
-        h = stoi(s.substr(x + 1));
-        return (w > 0 && h > 0);
+        const float ck = c[k];
+        const float *pk = proto.ptr<float>() + k * plane;
+        for (int y = y0; y < y1; ++y)
+        {
+            const float *src = pk + (size_t)y * pw;
+            float *dst = soft.ptr<float>(y - y0);
+            for (int x = x0; x < x1; ++x)
+                dst[x - x0] += ck * src[x];
+        }
     }
-    catch (...)
+    for (int y = 0; y < soft.rows; ++y)
     {
-        return false;
+        float *v = soft.ptr<float>(y);
+        for (int x = 0; x < soft.cols; ++x)
+            v[x] = 1.f / (1.f + std::exp(-v[x]));
     }
+
+    // Frame pixel (u, v) inside the box -> patch coords (pixel centres)
+    Matx23f M(sx, 0.f, (box.x + 0.5f) * sx + ox - 0.5f - x0,
+              0.f, sy, (box.y + 0.5f) * sy + oy - 0.5f - y0);
+    Mat up;
+    warpAffine(soft, up, M, box.size(), INTER_LINEAR | WARP_INVERSE_MAP, BORDER_REPLICATE);
+    return up > maskThr;
 }
 
-// ======================= Main =========================
-int main(int argc, char **argv)
+static void drawMask(Mat &frame, const Rect &box, const Mat &mask, const Scalar &color)
 {
-    if (argc < 2)
+    Mat roi = frame(box);
+    Mat tint;
+    addWeighted(roi, 0.5, Mat(roi.size(), roi.type(), color), 0.5, 0.0, tint);
+    tint.copyTo(roi, mask);
+}
+
+// COCO-style uncompressed RLE over the full frame (column-major, first run is
+// background). Only the box is visited; everything outside it is one long run.
+static vector<int> maskToRLE(const Mat &mask, const Rect &box, Size frameSize)
+{
+    vector<int> counts;
+    int run = 0;
+    uchar cur = 0;
+    auto pushRun = [&](uchar v, int n)
     {
-        printHelp(argv[0]);
-        return 0;
+        if (n <= 0)
+            return;
+        if (v == cur)
+            run += n;
+        else
+        {
+            counts.push_back(run);
+            run = n;
+            cur = v;
+        }
+    };
+    pushRun(0, box.x * frameSize.height);
+    for (int u = 0; u < box.width; ++u)
+    {
+        pushRun(0, box.y);
+        for (int v = 0; v < box.height; ++v)
+            pushRun(mask.at<uchar>(v, u) ? 1 : 0, 1);
+        pushRun(0, frameSize.height - box.y - box.height);
     }
+    pushRun(0, (frameSize.width - box.x - box.width) * frameSize.height);
+    counts.push_back(run);
+    return counts;
+}
 
-    YoloConfig cfg;
-    cfg.onnxPath = argv[1];
-    if (argc >= 3 && argv[2][0] != '-')
-        cfg.source = argv[2];
+struct Detection
+{
+    Rect box;
+    int classId = 0;
+    float score = 0.f;
+    Mat mask; // box-sized CV_8U, -seg models only
+};
 
-    // parse flags
-    for (int i = 2; i < argc; ++i)
+// Keep only the k best-scoring candidates (with their view ids and mask
+// coefficients) so NMS and mask bookkeeping stay bounded on cluttered frames.
+static void capCandidates(vector<Rect> &boxes, vector<float> &scores, vector<int> &classIds,
+                          vector<int> &viewIds, Mat &maskCoeffs, int k)
+{
+    if (k <= 0 || (int)boxes.size() <= k)
+        return;
+    vector<int> idx(boxes.size());
+    for (size_t i = 0; i < idx.size(); ++i)
+        idx[i] = (int)i;
+    nth_element(idx.begin(), idx.begin() + k, idx.end(),
+                [&](int a, int b)
+                { return scores[a] > scores[b]; });
+    idx.resize(k);
+    sort(idx.begin(), idx.end());
+
+    vector<Rect> b;
+    vector<float> sc;
+    vector<int> ci, vi;
+    Mat mc;
+    for (int i : idx)
     {
-        string a = argv[i];
-        if (a == "--yaml" && i + 1 < argc)
-            cfg.yamlPath = argv[++i];
-        else if (a == "--names" && i + 1 < argc)
-            cfg.namesPath = argv[++i];
-        else if (a == "--conf" && i + 1 < argc)
-            cfg.confThr = stof(argv[++i]);
-        else if (a == "--iou" && i + 1 < argc)
-            cfg.iouThr = stof(argv[++i]);
-        else if (a == "--size" && i + 1 < argc)
+        b.push_back(boxes[i]);
+        sc.push_back(scores[i]);
+        ci.push_back(classIds[i]);
+        vi.push_back(viewIds[i]);
+        if (i < maskCoeffs.rows)
+            mc.push_back(maskCoeffs.row(i));
+    }
+    boxes.swap(b);
+    scores.swap(sc);
+    classIds.swap(ci);
+    viewIds.swap(vi);
+    maskCoeffs = mc;
+}
+
+static vector<shmring::DetRecord> toDetRecords(const vector<Detection> &dets)
+{
+    vector<shmring::DetRecord> recs;
+    for (const Detection &d : dets)
+        recs.push_back({d.box.x, d.box.y, d.box.width, d.box.height, d.classId, d.score});
+    return recs;
+}
+
+static string jsonEscape(const string &s)
+{
+    string o;
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+            o.push_back('\\');
+        o.push_back(c);
+    }
+    return o;
+}
+
+// ---------------------- DETECTOR ----------------------
+// The net plus everything needed to turn its outputs into detections
+struct Detector
+{
+    vector<dnn::Net> nets; // nets[i] is set up for input sizes[i]
+    vector<Size> sizes;
+    vector<String> outNames; // all outputs (-seg / raw-head models have several)
+    int numClasses = 0;
+    AnchorHeadConfig anchors;
+    ZoneSet zones;
+    bool zoneBatch = false;
+};
+
+// One letterboxed region of the frame fed to the net as a batch entry
+struct InferView
+{
+    Rect roi;
+    Vec4i pad;
+    float scale = 1.f;
+};
+
+// Entry b of a batched output, as a batch-1 view (no copy)
+static Mat batchEntry(const Mat &m, int b)
+{
+    if (m.dims < 3 || m.size[0] == 1)
+        return m;
+    vector<int> sz(m.size.p, m.size.p + m.dims);
+    sz[0] = 1;
+    return Mat(sz, m.type(), (void *)m.ptr<float>(b));
+}
+
+// Net input for one frame: the views it was cut from and their blob
+struct PreparedInput
+{
+    vector<InferView> views; // empty = nothing to run (no zone in the frame)
+    Size inSize;
+    Mat blob;
+    long frameId = -1; // trace tag for stages on other threads (G-API engine)
+};
+
+// Letterbox + blob. With zones, only their bounding rect (or each zone,
+// batched) is fed to the net.
+static void prepareInput(Detector &d, const Mat &frame, Size inSize, PreparedInput &in)
+{
+    in.views.clear();
+    in.inSize = inSize;
+    auto addView = [&](const Rect &r)
+    {
+        InferView v;
+        v.roi = r;
+        in.views.push_back(v);
+    };
+    if (d.zones.empty())
+        addView(Rect(0, 0, frame.cols, frame.rows));
+    else
+    {
+        d.zones.resolve(frame.size());
+        if (d.zoneBatch)
         {
-            if (!parseSize(argv[++i], cfg.inputW, cfg.inputH))
-            {
-                cerr << "Bad --size\n";
-                return 1;
-            }
+            for (const Rect &r : d.zones.rects())
+                if (!r.empty())
+                    addView(r);
         }
-        else if (a == "--save" && i + 1 < argc)
-            cfg.savePath = argv[++i];
-        else if (a == "--cuda")
-            cfg.useCUDA = true;
-        else if (a.rfind("--", 0) == 0)
+        else if (!d.zones.unionRect().empty())
+            addView(d.zones.unionRect());
+        if (in.views.empty())
+            return;
+    }
+    vector<Mat> ins;
+    {
+        TRACE_SPAN("letterbox");
+        for (InferView &v : in.views)
+            ins.push_back(letterbox(frame(v.roi), inSize.width, inSize.height, v.pad, v.scale));
+    }
+    // Zones clipped away by the frame still take their batch slot: the net was
+    // warmed (and a fixed-batch export only runs) at one entry per zone.
+    // Padding entries have no view, so decode never looks at them.
+    if (d.zoneBatch)
+        while (ins.size() < d.zones.size())
+            ins.push_back(Mat(inSize, CV_8UC3, Scalar(114, 114, 114)));
+    TRACE_SPAN("blobFromImage");
+    in.blob = dnn::blobFromImages(ins, 1.0 / 255.0, inSize, Scalar(), /*swapRB=*/true, /*crop=*/false);
+}
+
+// OpenCV has one parallel_for_ pool per process, and a forward that starts
+// while another one is running gets no workers at all. The frame loop and a
+// background model load (its warm-up forwards) therefore take turns.
+static mutex g_forwardMutex;
+
+static void runNet(Detector &d, const Mat &blob, vector<Mat> &outs)
+{
+    lock_guard<mutex> lk(g_forwardMutex);
+    TRACE_SPAN("forward");
+    // A Net keeps buffers for one input shape; use the one warmed for this size
+    const Size inSize(blob.size[3], blob.size[2]);
+    size_t i = find(d.sizes.begin(), d.sizes.end(), inSize) - d.sizes.begin();
+    dnn::Net &net = d.nets[i < d.nets.size() ? i : 0];
+    net.setInput(blob);
+    net.forward(outs, d.outNames);
+}
+
+// Decode -> cap -> NMS -> lazy masks. Boxes come back in frame coordinates,
+// filtered by zone polygon.
+static vector<Detection> decodeOutputs(const Detector &d, const YoloConfig &cfg, const vector<Mat> &outs,
+                                       const PreparedInput &in, int maxCandidates)
+{
+    static bool printedShape = false;
+    const vector<InferView> &views = in.views;
+    const Size inSize = in.inSize;
+
+    // Raw YOLOv5/v7 heads are decoded host-side; otherwise one decoded
+    // tensor (+ prototypes for -seg models)
+    const bool rawHeads = isRawHeadOutput(outs);
+    if (!printedShape)
+    {
+        for (const Mat &o : outs)
         {
-            cerr << "Unknown option: " << a << "\n";
-            return 1;
+            cerr << "[DNN] out.dims=" << o.dims << " sizes=";
+            for (int i = 0; i < o.dims; ++i)
+                cerr << o.size[i] << " ";
+            cerr << " type=" << o.type() << " (CV_32F is 5)\n";
         }
+        if (rawHeads)
+            cerr << "[DNN] raw anchor heads: " << outs.size() << " scales\n";
+        printedShape = true;
     }
 
-    // Load classes
-    vector<string> classNames;
-    try
+    vector<Rect> boxes;
+    vector<float> scores;
+    vector<int> classIds, viewIds;
+    Mat maskCoeffs;
+    vector<Mat> protos(views.size());
+    for (size_t b = 0; b < views.size(); ++b)
     {
-        classNames = loadClassList(cfg);
+        const InferView &v = views[b];
+        vector<Mat> vouts;
+        for (const Mat &o : outs)
+            vouts.push_back(batchEntry(o, (int)b));
+
+        vector<Rect> vb;
+        vector<float> vs;
+        vector<int> vc;
+        Mat vm;
+        if (rawHeads)
+        {
+            TRACE_SPAN("decodeAnchorHeads");
+            decodeAnchorHeads(vouts, d.anchors, cfg.confThr, vb, vs, vc,
+                              v.roi.width, v.roi.height, v.scale, v.pad, inSize.width);
+        }
+        else
+        {
+            TRACE_SPAN("parseDetectionsRobust");
+            Mat out;
+            splitOutputs(vouts, out, protos[b]);
+            if (out.empty())
+                continue;
+            const int numMaskCoeffs = protos[b].empty() ? 0 : protos[b].size[1];
+            parseDetectionsRobust(out, cfg.confThr, vb, vs, vc,
+                                  v.roi.width, v.roi.height, v.scale, v.pad, inSize.width, inSize.height,
+                                  d.numClasses, /*debug=*/false, numMaskCoeffs, &vm);
+        }
+
+        for (size_t i = 0; i < vb.size(); ++i)
+        {
+            Rect box = vb[i] + v.roi.tl();
+            if (!d.zones.empty() && !d.zones.contains(box))
+                continue;
+            boxes.push_back(box);
+            scores.push_back(vs[i]);
+            classIds.push_back(vc[i]);
+            viewIds.push_back((int)b);
+            if ((int)i < vm.rows)
+                maskCoeffs.push_back(vm.row((int)i));
+        }
     }
-    catch (const exception &e)
+    capCandidates(boxes, scores, classIds, viewIds, maskCoeffs, maxCandidates);
+
+    vector<int> keep;
     {
-        cerr << e.what() << "\n";
-        return 2;
+        TRACE_SPAN("NMS");
+        dnn::NMSBoxes(boxes, scores, cfg.confThr, cfg.iouThr, keep);
     }
-    cout << "Loaded " << classNames.size() << " classes\n";
 
-    // Open source
-    VideoCapture cap;
-    if (cfg.source.size() == 1 && isdigit(cfg.source[0]))
-        cap.open(stoi(cfg.source), CAP_V4L2);
-    else
-        cap.open(cfg.source, CAP_V4L2);
-    if (!cap.isOpened())
+    vector<Detection> dets;
+    for (int i : keep)
     {
-        cerr << "ERROR: cannot open source: " << cfg.source << "\n";
-        return 3;
+        if (i < 0 || i >= (int)boxes.size())
+            continue;
+        Detection det;
+        det.box = boxes[i];
+        det.classId = classIds[i];
+        det.score = scores[i];
+        // Masks are decoded only for boxes that survived NMS
+        const int b = viewIds[i];
+        if (i < maskCoeffs.rows && !protos[b].empty())
+        {
+            TRACE_SPAN("decodeMask");
+            const InferView &v = views[b];
+            det.mask = decodeMask(maskCoeffs.row(i), protos[b], det.box - v.roi.tl(), v.scale, v.pad,
+                                  inSize.width, inSize.height, cfg.maskThr);
+        }
+        dets.push_back(det);
     }
-    cap.set(CAP_PROP_FRAME_WIDTH, 1280);
-    cap.set(CAP_PROP_FRAME_HEIGHT, 720);
-    cap.set(CAP_PROP_FOURCC, VideoWriter::fourcc('M', 'J', 'P', 'G'));
+    return dets;
+}
 
-    // Load net
-    dnn::Net net = dnn::readNet(cfg.onnxPath);
-    if (net.empty())
+// Letterbox -> forward -> decode -> cap -> NMS -> lazy masks for one frame,
+// each step on its pinned stage
+static vector<Detection> detectFrame(Detector &d, const YoloConfig &cfg, const Mat &frame, Size inSize,
+                                     int maxCandidates, StagePinner &pinner, TickMeter &tm)
+{
+    pinner.enter(Stage::Preprocess);
+    PreparedInput in;
+    prepareInput(d, frame, inSize, in);
+    if (in.views.empty())
+        return {};
+
+    pinner.enter(Stage::Inference);
+    vector<Mat> outs;
+    tm.start();
+    runNet(d, in.blob, outs);
+    tm.stop();
+
+    pinner.enter(Stage::Postprocess);
+    return decodeOutputs(d, cfg, outs, in, maxCandidates);
+}
+
+// One JSON object per frame: boxes, labels, and COCO RLE masks when present
+static string detectionsJson(long frameId, Size frameSize, const vector<Detection> &dets,
+                             const vector<string> &classNames)
+{
+    ostringstream js;
+    js << "{\"frame\":" << frameId << ",\"size\":[" << frameSize.height << "," << frameSize.width << "],\"dets\":[";
+    for (size_t k = 0; k < dets.size(); ++k)
     {
-        cerr << "ERROR: failed to load ONNX: " << cfg.onnxPath << "\n";
-        return 4;
+        const Detection &d = dets[k];
+        const Rect &b = d.box;
+        int cid = d.classId;
+        string label = (cid >= 0 && cid < (int)classNames.size()) ? classNames[cid] : ("id_" + to_string(cid));
+        js << (k ? "," : "") << "{\"cls\":" << cid << ",\"label\":\"" << jsonEscape(label)
+           << "\",\"score\":" << d.score << ",\"box\":[" << b.x << "," << b.y << ","
+           << b.width << "," << b.height << "]";
+        if (!d.mask.empty())
+        {
+            js << ",\"counts\":[";
+            vector<int> counts = maskToRLE(d.mask, b, frameSize);
+            for (size_t j = 0; j < counts.size(); ++j)
+                js << (j ? "," : "") << counts[j];
+            js << "]";
+        }
+        js << "}";
+    }
+    js << "]}";
+    return js.str();
+}
+
+static void drawDetections(Mat &frame, const vector<Detection> &dets, const vector<string> &classNames)
+{
+    TRACE_SPAN("drawDet");
+    for (const Detection &d : dets)
+    {
+        int cid = d.classId;
+        string label = (cid >= 0 && cid < (int)classNames.size()) ? classNames[cid] : ("id_" + to_string(cid));
+        if (!d.mask.empty())
+            drawMask(frame, d.box, d.mask, classColor(cid));
+        drawDet(frame, d.box, label, d.score, classColor(cid));
+    }
+}
+
+static void drawFps(Mat &frame, double fps)
+{
+    putText(frame, format("FPS: %.1f", fps), Point(10, 30), FONT_HERSHEY_SIMPLEX, 0.9, Scalar(0, 0, 0), 3);
+    putText(frame, format("FPS: %.1f", fps), Point(10, 30), FONT_HERSHEY_SIMPLEX, 0.9, Scalar(255, 255, 255), 1);
+}
+
+// End-of-run summary, same format for every engine so runs on the same
+// input can be compared: throughput and capture-to-display latency
+static void printBenchmark(const string &engine, double seconds, vector<double> latencyMs)
+{
+    const size_t n = latencyMs.size();
+    cout << "[bench] engine=" << engine << " frames=" << n << " time=" << format("%.2fs", seconds)
+         << " fps=" << format("%.2f", seconds > 0 ? n / seconds : 0.0);
+    if (n > 0)
+    {
+        sort(latencyMs.begin(), latencyMs.end());
+        auto pct = [&](double p)
+        { return latencyMs[min(n - 1, (size_t)(p * (n - 1) + 0.5))]; };
+        double mean = 0;
+        for (double v : latencyMs)
+            mean += v / n;
+        cout << format(" latency_ms mean=%.1f p50=%.1f p95=%.1f p99=%.1f max=%.1f", mean, pct(0.50), pct(0.95),
+                       pct(0.99), latencyMs.back());
     }
+    cout << "\n";
+}
+
+// ======================= Startup report ========================
+// Startup phases overlap (net load runs beside source open and class
+// parsing, warm-up beside the first captures), so each is logged with its
+// start offset and duration; the report prints with the first detection.
+struct StartupPhase
+{
+    const char *name;
+    double startMs, durMs;
+};
+
+struct StartupReport
+{
+    int64 origin = getTickCount();
+    mutex m;
+    vector<StartupPhase> phases;
+};
+
+// Phase from `startTick` until now; callable from any thread
+static void recordPhase(StartupReport &r, const char *name, int64 startTick)
+{
+    const double f = 1e3 / getTickFrequency();
+    const double durMs = (getTickCount() - startTick) * f;
+    lock_guard<mutex> lk(r.m);
+    r.phases.push_back({name, (startTick - r.origin) * f, durMs});
+}
+
+// Records one phase from construction to end of scope
+class StartupTimer
+{
+public:
+    StartupTimer(StartupReport &r, const char *name) : r_(r), name_(name), start_(getTickCount()) {}
+    ~StartupTimer() { recordPhase(r_, name_, start_); }
+
+private:
+    StartupReport &r_;
+    const char *name_;
+    int64 start_;
+};
+
+// `frameAgeMs`: how long the first detected frame had been waiting since
+// capture; `staleDropped`: camera frames queued during warm-up and skipped
+static void printStartupReport(StartupReport &r, ostream &os, double frameAgeMs, long staleDropped)
+{
+    const double totalMs = (getTickCount() - r.origin) * 1e3 / getTickFrequency();
+    lock_guard<mutex> lk(r.m);
+    sort(r.phases.begin(), r.phases.end(), [](const StartupPhase &a, const StartupPhase &b)
+         { return a.startMs < b.startMs; });
+    os << "[startup] phase              start      took\n";
+    for (const StartupPhase &p : r.phases)
+        os << format("[startup] %-16s %7.1fms %8.1fms\n", p.name, p.startMs, p.durMs);
+    os << format("[startup] first detection at %.1fms on a frame captured %.1fms earlier", totalMs, frameAgeMs);
+    if (staleDropped > 0)
+        os << format(" (%ld stale frames from warm-up dropped)", staleDropped);
+    os << "\n";
+}
+
+// ======================= Model loading ========================
+// Everything that comes from the model file. Built once at startup and again,
+// on a background thread, for every hot-swap; the frame loop only ever sees a
+// fully warmed-up one.
+struct LoadedModel
+{
+    YoloConfig spec; // config it was loaded from (onnx, size, class list)
+    vector<dnn::Net> nets; // one per size: a Net only keeps one input shape set up
+    vector<String> outNames;
+    vector<string> classNames;
+    vector<Size> sizes; // input ladder, [0] = --size
+    bool zoneBatch = false;
+};
 
+static void setBackend(dnn::Net &net, bool useCUDA)
+{
     try
     {
-        if (cfg.useCUDA)
+        if (useCUDA)
         {
 #ifdef HAVE_CUDA
             net.setPreferableBackend(dnn::DNN_BACKEND_CUDA);
@@ -579,26 +1034,847 @@ int main(int argc, char **argv)
     {
         cerr << "DNN backend/target set failed: " << e.what() << "\n";
     }
+}
 
-    // Warmup
+// readNet + backend. Returns false (with `err`) if the file doesn't load.
+static bool loadNet(const YoloConfig &cfg, LoadedModel &m, string &err)
+{
+    m.spec = cfg;
+    dnn::Net net;
+    try
     {
-        Mat dummy(cfg.inputH, cfg.inputW, CV_8UC3, Scalar(114, 114, 114));
-        Mat blob = dnn::blobFromImage(dummy, 1.0 / 255.0, Size(cfg.inputW, cfg.inputH), Scalar(), true, false);
-        net.setInput(blob);
-        (void)net.forward();
+        net = dnn::readNet(cfg.onnxPath);
     }
-
-    // Optional writer
-    VideoWriter writer;
-    bool save = false;
-    if (!cfg.savePath.empty())
+    catch (const cv::Exception &e)
     {
-        int fourcc = VideoWriter::fourcc('m', 'p', '4', 'v');
-        double fps = cap.get(CAP_PROP_FPS);
-        if (fps <= 0)
+        err = "failed to load ONNX: " + cfg.onnxPath + " (" + e.what() + ")";
+        return false;
+    }
+    if (net.empty())
+    {
+        err = "failed to load ONNX: " + cfg.onnxPath;
+        return false;
+    }
+    setBackend(net, cfg.useCUDA);
+    m.outNames = net.getUnconnectedOutLayersNames();
+    m.nets = {net};
+    return true;
+}
+
+// Build the input size ladder and warm up one net per size (the loaded net
+// serves --size).
+// Returns false (with `err`) if the model can't serve --size.
+static bool warmUp(LoadedModel &m, size_t numZones, const AnchorHeadConfig &anchors, string &err)
+{
+    const YoloConfig &cfg = m.spec;
+
+    // Input size ladder: --size first, then any smaller --adapt-sizes
+    m.sizes = {Size(cfg.inputW, cfg.inputH)};
+    if (cfg.targetLatencyMs > 0)
+    {
+        vector<Size> extra = cfg.adaptSizes;
+        sort(extra.begin(), extra.end(), [](const Size &a, const Size &b)
+             { return a.area() > b.area(); });
+        for (const Size &sz : extra)
+        {
+            if (sz.area() >= m.sizes[0].area())
+                cerr << "Warning: --adapt-sizes " << sz.width << "x" << sz.height << " is not smaller than --size "
+                     << cfg.inputW << "x" << cfg.inputH << ", ignoring it\n";
+            else if (sz.area() < m.sizes.back().area())
+                m.sizes.push_back(sz);
+        }
+    }
+
+    // A Net reallocates (and re-initialises the backend) whenever the input
+    // shape changes, so every extra size gets its own copy of the net, warmed
+    // once at that size; switching sizes never touches a cold shape. Costs
+    // one set of weights per size. Sizes the model cannot take (static-shape
+    // exports) are dropped, and a fixed batch-1 model turns --zone-batch into
+    // a single union crop.
+    m.nets.resize(1);
+    m.zoneBatch = cfg.zoneBatch && numZones > 0;
+    for (size_t k = 0; k < m.sizes.size();)
+    {
+        try
+        {
+            if (k == m.nets.size())
+            {
+                dnn::Net net = dnn::readNet(cfg.onnxPath);
+                setBackend(net, cfg.useCUDA);
+                m.nets.push_back(net);
+            }
+            size_t batch = m.zoneBatch ? numZones : 1;
+            vector<Mat> dummies(batch, Mat(m.sizes[k], CV_8UC3, Scalar(114, 114, 114)));
+            Mat blob = dnn::blobFromImages(dummies, 1.0 / 255.0, m.sizes[k], Scalar(), true, false);
+            vector<Mat> outs;
+            {
+                lock_guard<mutex> lk(g_forwardMutex);
+                m.nets[k].setInput(blob);
+                m.nets[k].forward(outs, m.outNames);
+            }
+            // Raw heads that don't fit the anchor config would only fail
+            // inside the frame loop
+            if (k == 0 && isRawHeadOutput(outs) && !checkAnchorHeads(outs, anchors, err))
+            {
+                err = cfg.onnxPath + ": " + err +
+                      (cfg.anchorsPath.empty() ? " (default YOLOv5 P3-P5 anchors; pass --anchors)"
+                                               : " (anchors from " + cfg.anchorsPath + ")");
+                return false;
+            }
+            ++k;
+        }
+        catch (const cv::Exception &e)
+        {
+            if (m.zoneBatch && numZones > 1)
+            {
+                cerr << "Warning: model rejects batched input, --zone-batch falls back to one crop\n";
+                m.zoneBatch = false;
+                k = 0; // re-warm the nets already set up for the batch
+                continue;
+            }
+            if (k == 0)
+            {
+                err = "warm-up failed for " + cfg.onnxPath + " at " + to_string(m.sizes[0].width) + "x" +
+                      to_string(m.sizes[0].height) + ": " + e.what();
+                return false;
+            }
+            cerr << "Warning: model rejects input " << m.sizes[k].width << "x" << m.sizes[k].height
+                 << ", dropping it from --adapt-sizes\n";
+            m.sizes.erase(m.sizes.begin() + k);
+            if (k < m.nets.size())
+                m.nets.erase(m.nets.begin() + k);
+        }
+    }
+    return true;
+}
+
+// Everything but the class names, as used for hot-swaps
+static bool loadModel(const YoloConfig &cfg, size_t numZones, const AnchorHeadConfig &anchors, LoadedModel &m,
+                      string &err)
+{
+    return loadNet(cfg, m, err) && warmUp(m, numZones, anchors, err);
+}
+
+static void applyModel(Detector &d, const LoadedModel &m)
+{
+    d.nets = m.nets;
+    d.sizes = m.sizes;
+    d.outNames = m.outNames;
+    d.numClasses = (int)m.classNames.size();
+    d.zoneBatch = m.zoneBatch;
+}
+
+static bool parseSize(const string &s, int &w, int &h)
+{
+    size_t x = s.find('x');
+    if (x == string::npos)
+        return false;
+    try
+    {
+        w = stoi(s.substr(0, x));
+        h = stoi(s.substr(x + 1));
+        return (w > 0 && h > 0);
+    }
+    catch (...)
+    {
+        return false;
+    }
+}
+
+// Model control file for hot-swaps, "key: value" per line; keys left out
+// keep their current value:
+//   model: models/yolo11s.onnx
+//   size:  640x640
+//   yaml:  coco/coco.yaml     (or names: coco/coco.names)
+static bool readModelControl(const string &path, YoloConfig &cfg, string &err)
+{
+    ifstream in(path);
+    if (!in.is_open())
+    {
+        err = "cannot open " + path;
+        return false;
+    }
+    string line;
+    while (getline(in, line))
+    {
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty())
+            continue;
+        size_t colon = line.find(':');
+        if (colon == string::npos)
+        {
+            err = "bad line in " + path + ": " + line;
+            return false;
+        }
+        string key = trim(line.substr(0, colon)), val = trim(line.substr(colon + 1));
+        if (key == "model")
+            cfg.onnxPath = val;
+        else if (key == "size")
+        {
+            if (!parseSize(val, cfg.inputW, cfg.inputH))
+            {
+                err = "bad size in " + path + ": " + val;
+                return false;
+            }
+        }
+        else if (key == "yaml")
+        {
+            cfg.yamlPath = val;
+            cfg.namesPath.clear();
+        }
+        else if (key == "names")
+        {
+            cfg.namesPath = val;
+            cfg.yamlPath.clear();
+        }
+        else
+        {
+            err = "unknown key in " + path + ": " + key;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Change stamp of the control file (mtime + size); 0 if it doesn't exist
+static int64 fileStamp(const string &path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return 0;
+    return (int64)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec + st.st_size;
+}
+
+static volatile sig_atomic_t g_stop = 0;
+static volatile sig_atomic_t g_reload = 0;
+
+static void onSignal(int)
+{
+    g_stop = 1;
+}
+
+static void onReloadSignal(int)
+{
+    g_reload = 1;
+}
+
+static void onDumpSignal(int)
+{
+    trace::requestDump();
+}
+
+// Writer stage: encodes queued frames until the queue is closed
+static void writerLoop(BoundedQueue<CapturedFrame> &toWrite, VideoWriter &writer, const vector<int> &cpus)
+{
+    pinCurrentThread(cpus);
+    TRACE_THREAD("writer");
+    CapturedFrame f;
+    while (toWrite.pop(f))
+    {
+        TRACE_FRAME(f.index);
+        TRACE_SPAN("write");
+        writer << f.image;
+    }
+}
+
+#ifdef YOLO_WITH_GAPI
+// ======================= G-API engine ========================
+// The same three steps as detectFrame(), as custom kernels of a streaming
+// graph:  frame -> GPreprocess -> GForward -> GDecode -> detections
+// Each step is its own island, and G-API's streaming executor runs every
+// island (and the source) on its own thread, so consecutive frames overlap
+// across stages. Drawing stays on the main thread and --save on a writer
+// thread, as in the loop engine.
+struct NetOutputs
+{
+    vector<Mat> outs;
+};
+
+// What the kernels need from main(), handed over as a compile arg
+struct GapiContext
+{
+    Detector *detector = nullptr;
+    const YoloConfig *cfg = nullptr;
+    Size inSize;
+};
+
+namespace cv
+{
+    namespace detail
+    {
+        template <>
+        struct CompileArgTag<GapiContext>
+        {
+            static const char *tag() { return "yolo.context"; }
+        };
+    }
+}
+
+G_API_OP(GPreprocess, <GOpaque<PreparedInput>(GMat, GOpaque<int64_t>)>, "yolo.preprocess")
+{
+    static GOpaqueDesc outMeta(const GMatDesc &, const GOpaqueDesc &) { return empty_gopaque_desc(); }
+};
+
+G_API_OP(GForward, <GOpaque<NetOutputs>(GOpaque<PreparedInput>)>, "yolo.forward")
+{
+    static GOpaqueDesc outMeta(const GOpaqueDesc &) { return empty_gopaque_desc(); }
+};
+
+G_API_OP(GDecode, <GArray<Detection>(GOpaque<NetOutputs>, GOpaque<PreparedInput>)>, "yolo.decode")
+{
+    static GArrayDesc outMeta(const GOpaqueDesc &, const GOpaqueDesc &) { return empty_array_desc(); }
+};
+
+// Feeds the graph from the VideoCapture main() opened (V4L2, 1280x720 MJPG),
+// so both engines are benchmarked on the same camera setup. Same contract as
+// GCaptureSource: the first frame is read up front for the graph metadata,
+// and every frame carries a system_clock timestamp in microseconds.
+// G-API spawns the source and island threads from the main thread, i.e. on
+// the inference CPUs; each one moves itself onto its stage's CPUs on first use
+static void pinGapiThread(const ThreadLayout &layout, Stage s, const char *name)
+{
+    thread_local bool pinned = false;
+    if (pinned)
+        return;
+    pinCurrentThread(layout[s]);
+    TRACE_THREAD(name);
+    (void)name;
+    pinned = true;
+}
+
+class CaptureSource : public gapi::wip::IStreamSource
+{
+public:
+    CaptureSource(VideoCapture &cap, const ThreadLayout &layout) : cap_(cap), layout_(layout)
+    {
+        if (!cap_.read(first_) || first_.empty())
+            throw runtime_error("no frames");
+        desc_ = cv::descr_of(first_);
+    }
+
+    bool pull(gapi::wip::Data &data) override
+    {
+        pinGapiThread(layout_, Stage::Capture, "capture");
+        TRACE_FRAME(seq_);
+        Mat f;
+        if (!first_.empty())
+            swap(f, first_);
+        else
+        {
+            TRACE_SPAN("capture");
+            if (!cap_.read(f) || f.empty())
+                return false;
+        }
+        data = f;
+        const int64_t nowUs =
+            chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+        data.meta[gapi::streaming::meta_tag::timestamp] = nowUs;
+        data.meta[gapi::streaming::meta_tag::seq_id] = seq_++;
+        return true;
+    }
+
+    GMetaArg descr_of() const override { return GMetaArg{desc_}; }
+
+private:
+    VideoCapture &cap_;
+    const ThreadLayout &layout_;
+    Mat first_;
+    GMatDesc desc_;
+    int64_t seq_ = 0;
+};
+
+static shared_ptr<GapiContext> gapiContext(const GCompileArgs &args)
+{
+    auto ctx = gapi::getCompileArg<GapiContext>(args);
+    CV_Assert(ctx.has_value());
+    return make_shared<GapiContext>(ctx.value());
+}
+
+GAPI_OCV_KERNEL_ST(GOCVPreprocess, GPreprocess, GapiContext)
+{
+    static void setup(const GMatDesc &, const GOpaqueDesc &, shared_ptr<GapiContext> &st,
+                      const GCompileArgs &args)
+    {
+        st = gapiContext(args);
+    }
+    static void run(const Mat &frame, const int64_t &seq, PreparedInput &in, GapiContext &ctx)
+    {
+        pinGapiThread(ctx.cfg->layout, Stage::Preprocess, "preprocess");
+        TRACE_FRAME((long)seq);
+        prepareInput(*ctx.detector, frame, ctx.inSize, in);
+        in.frameId = (long)seq;
+    }
+};
+
+GAPI_OCV_KERNEL_ST(GOCVForward, GForward, GapiContext)
+{
+    static void setup(const GOpaqueDesc &, shared_ptr<GapiContext> &st, const GCompileArgs &args)
+    {
+        st = gapiContext(args);
+    }
+    static void run(const PreparedInput &in, NetOutputs &out, GapiContext &ctx)
+    {
+        pinGapiThread(ctx.cfg->layout, Stage::Inference, "inference");
+        TRACE_FRAME(in.frameId);
+        out.outs.clear();
+        if (!in.views.empty())
+            runNet(*ctx.detector, in.blob, out.outs);
+    }
+};
+
+GAPI_OCV_KERNEL_ST(GOCVDecode, GDecode, GapiContext)
+{
+    static void setup(const GOpaqueDesc &, const GOpaqueDesc &, shared_ptr<GapiContext> &st,
+                      const GCompileArgs &args)
+    {
+        st = gapiContext(args);
+    }
+    static void run(const NetOutputs &out, const PreparedInput &in, vector<Detection> &dets, GapiContext &ctx)
+    {
+        pinGapiThread(ctx.cfg->layout, Stage::Postprocess, "postprocess");
+        TRACE_FRAME(in.frameId);
+        dets.clear();
+        if (!in.views.empty())
+            dets = decodeOutputs(*ctx.detector, *ctx.cfg, out.outs, in, ctx.cfg->maxCandidates);
+    }
+};
+
+// Runs until the source ends, 'q'/ESC or SIGINT. Returns main()'s exit code.
+static int runGapiEngine(Detector &detector, const YoloConfig &cfg, const LoadedModel &model, VideoCapture &cap,
+                         VideoWriter &writer, ofstream &rleOut, StartupReport &startup)
+{
+    namespace wip = gapi::wip;
+
+    GMat in;
+    GOpaque<int64_t> frameSeq = gapi::streaming::seq_id(in); // set by CaptureSource
+    GOpaque<PreparedInput> prepared = GPreprocess::on(in, frameSeq);
+    GOpaque<NetOutputs> netOuts = GForward::on(prepared);
+    GArray<Detection> dets = GDecode::on(netOuts, prepared);
+    // Kernels of one island run back to back on one thread; split them so
+    // the stages pipeline instead
+    gapi::island("preprocess", GIn(in, frameSeq), GOut(prepared));
+    gapi::island("infer", GIn(prepared), GOut(netOuts));
+    gapi::island("decode", GIn(netOuts, prepared), GOut(dets));
+    GOpaque<int64_t> captureTs = gapi::streaming::timestamp(in); // set by CaptureSource
+    GComputation graph(GIn(in), GOut(gapi::copy(in), dets, captureTs));
+
+    GapiContext ctx;
+    ctx.detector = &detector;
+    ctx.cfg = &cfg;
+    ctx.inSize = model.sizes[0];
+    GStreamingCompiled pipeline =
+        graph.compileStreaming(compile_args(gapi::kernels<GOCVPreprocess, GOCVForward, GOCVDecode>(), ctx));
+
+    try
+    {
+        pipeline.setSource(gin(wip::make_src<CaptureSource>(cap, cfg.layout)));
+    }
+    catch (const exception &e)
+    {
+        cerr << "ERROR: cannot open source: " << cfg.source << " (" << e.what() << ")\n";
+        return 3;
+    }
+
+    // The kernels resolve the zones on their own thread; draw from a copy
+    ZoneSet zones = detector.zones;
+
+    BoundedQueue<CapturedFrame> toWrite(4);
+    thread writerThread;
+    if (writer.isOpened())
+        writerThread = thread(writerLoop, ref(toWrite), ref(writer), cref(cfg.layout[Stage::Writer]));
+
+    cout << "Running (G-API streaming). Press 'q' or ESC to quit.\n";
+    pipeline.start();
+    const int64 startTick = getTickCount();
+    int64 lastTick = startTick;
+    vector<double> latencyMs;
+    double fps = 0;
+    Mat frame;
+    vector<Detection> out;
+    int64_t tsUs = 0;
+    for (long frameId = 0; pipeline.pull(gout(frame, out, tsUs)); ++frameId)
+    {
+        TRACE_FRAME(frameId);
+        TRACE_SPAN("frame");
+        int64 now = getTickCount();
+        fps = getTickFrequency() / max<int64>(now - lastTick, 1);
+        lastTick = now;
+        if (frameId == 0)
+        {
+            const int64_t nowUs = chrono::duration_cast<chrono::microseconds>(
+                                      chrono::system_clock::now().time_since_epoch())
+                                      .count();
+            printStartupReport(startup, cout, (nowUs - tsUs) / 1e3, 0);
+        }
+
+        if (!zones.empty())
+        {
+            zones.resolve(frame.size());
+            zones.draw(frame);
+        }
+        if (rleOut.is_open())
+            rleOut << detectionsJson(frameId, frame.size(), out, model.classNames) << "\n";
+        drawDetections(frame, out, model.classNames);
+        drawFps(frame, fps);
+
+        if (cfg.display)
+        {
+            TRACE_SPAN("display");
+            imshow("YOLOv11 - OpenCV DNN (fixed)", frame);
+        }
+        if (writerThread.joinable())
+        {
+            toWrite.push({frame, 0, frameId});
+            frame.release(); // the next pull must not write into a queued frame
+        }
+
+        const int64_t nowUs =
+            chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+        latencyMs.push_back((nowUs - tsUs) / 1e3);
+
+        if (!cfg.tracePath.empty() && trace::dumpRequested())
+            trace::dump(cfg.tracePath);
+        if (g_stop)
+            break;
+        if (!cfg.display)
+            continue;
+        TRACE_SPAN("waitKey");
+        int key = waitKey(1);
+        if (key == 27 || key == 'q' || key == 'Q')
+            break;
+    }
+    pipeline.stop();
+    toWrite.close();
+    if (writerThread.joinable())
+        writerThread.join();
+    printBenchmark("gapi", (getTickCount() - startTick) / getTickFrequency(), latencyMs);
+    return 0;
+}
+#endif
+
+static void printHelp(const char *prog)
+{
+    cout << "Usage:\n"
+            "  "
+         << prog << " <yolo11.onnx> [source]\n"
+                    "Options:\n"
+                    "  --yaml path        Load classes from coco.yaml\n"
+                    "  --names path       Load classes from .names file\n"
+                    "  --conf f           Confidence threshold (default 0.25)\n"
+                    "  --iou f            IoU threshold for NMS (default 0.45)\n"
+                    "  --size WxH         Inference size (default 640x640)\n"
+                    "  --save out.mp4     Save annotated video\n"
+                    "  --mask-thr f       Mask threshold for -seg models (default 0.5)\n"
+                    "  --rle out.jsonl    Write per-frame instance masks as COCO RLE\n"
+                    "  --anchors path     Anchors/strides yaml for raw YOLOv5/v7 heads (default: v5 P3-P5)\n"
+                    "  --zones path       Only run on these ROI polygons (crop to their bounding rect)\n"
+                    "  --zone-batch       With --zones: one batch entry per zone instead of one crop\n"
+                    "  --shm name         Publish frames + detections to /dev/shm/name (see shm_consumer)\n"
+                    "  --shm-slots n      Ring size in frames (default 8)\n"
+                    "  --shm-annotated    Publish frames with boxes drawn instead of raw frames\n"
+                    "  --http port        Serve MJPEG preview + JSON detections on this port\n"
+                    "  --http-bind addr   Address to listen on (default 127.0.0.1)\n"
+                    "  --preview-size WxH Preview fits inside this size (default 640x360)\n"
+                    "  --preview-fps f    Max preview frame rate (default 10)\n"
+                    "  --jpeg-quality q   Preview JPEG quality (default 75)\n"
+                    "  --no-display       Do not open a window (headless; stop with Ctrl-C)\n"
+                    "  --engine e         loop (default) or gapi (OpenCV G-API streaming graph)\n"
+                    "  --offline          Video file input: decode keyframe-aligned chunks in parallel\n"
+                    "  --decode-workers n With --offline: decoder threads (default 4)\n"
+                    "  --decode-buffer-mb n With --offline: cap on decoded frames held ahead (default 1024)\n"
+                    "  --model-control f  Hot-swap model/size/classes when this file changes (or on SIGHUP)\n"
+                    "  --trace out.json   Record per-stage spans; Chrome trace written on exit and on SIGUSR1\n"
+                    "  --trace-events n   Spans kept per thread (default 65536, oldest dropped)\n"
+                    "  --cuda             Use CUDA DNN backend (if available)\n"
+                    "  --threads n        OpenCV/DNN worker threads (default: inference cores)\n"
+                    "  --pin stage=cpus   Pin a stage to CPUs, e.g. inference=4-7 or capture=node0\n"
+                    "                     stages: capture preprocess inference postprocess writer\n"
+                    "  --isolate-inference  Keep all other stages off the inference CPUs\n"
+                    "  --detect-every n   Run the net every n-th frame (default 1)\n"
+                    "  --max-candidates k Keep at most k candidates before NMS (default all)\n"
+                    "  --target-latency t Adapt quality to keep end-to-end latency under t (e.g. 50ms)\n"
+                    "  --adapt-sizes list Smaller input sizes the controller may use, e.g. 480x480,320x320\n"
+                    "  --adapt-max-every n  Largest detect-every the controller may use (default 3)\n"
+                    "  --adapt-min-candidates k  Tightest candidate cap the controller may use (default 300)\n";
+}
+
+// ======================= Main =========================
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        printHelp(argv[0]);
+        return 0;
+    }
+
+    StartupReport startup;
+    YoloConfig cfg;
+    cfg.onnxPath = argv[1];
+    if (argc >= 3 && argv[2][0] != '-')
+        cfg.source = argv[2];
+
+    // parse flags
+    for (int i = 2; i < argc; ++i)
+    {
+        string a = argv[i];
+        if (a == "--yaml" && i + 1 < argc)
+            cfg.yamlPath = argv[++i];
+        else if (a == "--names" && i + 1 < argc)
+            cfg.namesPath = argv[++i];
+        else if (a == "--conf" && i + 1 < argc)
+            cfg.confThr = stof(argv[++i]);
+        else if (a == "--iou" && i + 1 < argc)
+            cfg.iouThr = stof(argv[++i]);
+        else if (a == "--size" && i + 1 < argc)
+        {
+            if (!parseSize(argv[++i], cfg.inputW, cfg.inputH))
+            {
+                cerr << "Bad --size\n";
+                return 1;
+            }
+        }
+        else if (a == "--save" && i + 1 < argc)
+            cfg.savePath = argv[++i];
+        else if (a == "--mask-thr" && i + 1 < argc)
+            cfg.maskThr = stof(argv[++i]);
+        else if (a == "--rle" && i + 1 < argc)
+            cfg.rlePath = argv[++i];
+        else if (a == "--anchors" && i + 1 < argc)
+            cfg.anchorsPath = argv[++i];
+        else if (a == "--zones" && i + 1 < argc)
+            cfg.zonesPath = argv[++i];
+        else if (a == "--zone-batch")
+            cfg.zoneBatch = true;
+        else if (a == "--shm" && i + 1 < argc)
+            cfg.shmName = argv[++i];
+        else if (a == "--shm-slots" && i + 1 < argc)
+            cfg.shmSlots = max(2, stoi(argv[++i]));
+        else if (a == "--shm-annotated")
+            cfg.shmAnnotated = true;
+        else if (a == "--http" && i + 1 < argc)
+            cfg.http.port = stoi(argv[++i]);
+        else if (a == "--http-bind" && i + 1 < argc)
+            cfg.http.bindAddr = argv[++i];
+        else if (a == "--preview-size" && i + 1 < argc)
+        {
+            if (!parseSize(argv[++i], cfg.http.size.width, cfg.http.size.height))
+            {
+                cerr << "Bad --preview-size\n";
+                return 1;
+            }
+        }
+        else if (a == "--preview-fps" && i + 1 < argc)
+            cfg.http.fps = stod(argv[++i]);
+        else if (a == "--jpeg-quality" && i + 1 < argc)
+            cfg.http.quality = stoi(argv[++i]);
+        else if (a == "--no-display")
+            cfg.display = false;
+        else if (a == "--engine" && i + 1 < argc)
+        {
+            cfg.engine = argv[++i];
+            if (cfg.engine != "loop" && cfg.engine != "gapi")
+            {
+                cerr << "Bad --engine (loop or gapi)\n";
+                return 1;
+            }
+#ifndef YOLO_WITH_GAPI
+            if (cfg.engine == "gapi")
+            {
+                cerr << "--engine gapi needs OpenCV >= 4.6 built with the gapi module\n";
+                return 1;
+            }
+#endif
+        }
+        else if (a == "--offline")
+            cfg.offline = true;
+        else if (a == "--decode-workers" && i + 1 < argc)
+            cfg.decode.workers = max(1, stoi(argv[++i]));
+        else if (a == "--decode-buffer-mb" && i + 1 < argc)
+            cfg.decode.maxBufferedMB = (size_t)max(1, stoi(argv[++i]));
+        else if (a == "--model-control" && i + 1 < argc)
+            cfg.modelControl = argv[++i];
+        else if (a == "--trace" && i + 1 < argc)
+            cfg.tracePath = argv[++i];
+        else if (a == "--trace-events" && i + 1 < argc)
+            cfg.traceEvents = (size_t)max(16, stoi(argv[++i]));
+        else if (a == "--cuda")
+            cfg.useCUDA = true;
+        else if (a == "--threads" && i + 1 < argc)
+            cfg.layout.cvThreads = stoi(argv[++i]);
+        else if (a == "--pin" && i + 1 < argc)
+        {
+            if (!parsePinSpec(argv[++i], cfg.layout))
+            {
+                cerr << "Bad --pin " << argv[i] << "\n";
+                return 1;
+            }
+        }
+        else if (a == "--isolate-inference")
+            cfg.layout.isolateInference = true;
+        else if (a == "--detect-every" && i + 1 < argc)
+            cfg.detectEvery = max(1, stoi(argv[++i]));
+        else if (a == "--max-candidates" && i + 1 < argc)
+            cfg.maxCandidates = max(0, stoi(argv[++i]));
+        else if (a == "--target-latency" && i + 1 < argc)
+        {
+            if (!parseDurationMs(argv[++i], cfg.targetLatencyMs))
+            {
+                cerr << "Bad --target-latency\n";
+                return 1;
+            }
+        }
+        else if (a == "--adapt-sizes" && i + 1 < argc)
+        {
+            stringstream ss(argv[++i]);
+            string tok;
+            while (getline(ss, tok, ','))
+            {
+                int w = 0, h = 0;
+                if (!parseSize(tok, w, h))
+                {
+                    cerr << "Bad --adapt-sizes\n";
+                    return 1;
+                }
+                cfg.adaptSizes.push_back(Size(w, h));
+            }
+        }
+        else if (a == "--adapt-max-every" && i + 1 < argc)
+            cfg.adaptMaxEvery = max(1, stoi(argv[++i]));
+        else if (a == "--adapt-min-candidates" && i + 1 < argc)
+            cfg.adaptMinCandidates = max(0, stoi(argv[++i]));
+        else if (a.rfind("--", 0) == 0)
+        {
+            cerr << "Unknown option: " << a << "\n";
+            return 1;
+        }
+    }
+
+    if (!cfg.tracePath.empty())
+    {
+#ifdef YOLO_TRACE
+        trace::enable(cfg.traceEvents);
+        TRACE_THREAD("main");
+        signal(SIGUSR1, onDumpSignal);
+        cout << "Tracing to " << cfg.tracePath << " (kill -USR1 " << getpid() << " to dump now)\n";
+#else
+        cerr << "Warning: built without YOLO_TRACE, --trace ignored\n";
+        cfg.tracePath.clear();
+#endif
+    }
+
+    // A control file that already exists decides the initial model too
+    int64 controlStamp = 0;
+    if (!cfg.modelControl.empty() && (controlStamp = fileStamp(cfg.modelControl)) != 0)
+    {
+        string err;
+        if (!readModelControl(cfg.modelControl, cfg, err))
+        {
+            cerr << err << "\n";
+            return 1;
+        }
+    }
+
+    // Thread budget + placement. Threads spawned by the capture backend and by
+    // OpenCV's pool inherit the affinity of the thread that creates them. The
+    // pool is created lazily by the first parallel_for_ on any thread (the
+    // --save probe's colour conversion, the net load, ...), so force it into
+    // existence here, on the inference CPUs, before anything else runs.
+    int cvThreads = cfg.layout.cvThreads;
+    if (cvThreads <= 0 && !cfg.layout[Stage::Inference].empty())
+        cvThreads = (int)cfg.layout[Stage::Inference].size();
+    finalizeLayout(cfg.layout);
+    if (cvThreads > 0)
+        setNumThreads(cvThreads);
+    StagePinner pinner(cfg.layout);
+    pinner.enter(Stage::Inference);
+    parallel_for_(Range(0, max(getNumThreads(), 2) * 4), [](const Range &) {});
+    pinner.enter(Stage::Capture);
+
+    // readNet + backend on the inference CPUs, while this thread parses the
+    // class list and opens the source. Nothing touches `model` until get().
+    LoadedModel model;
+    string netErr;
+    auto loadNetTask = [&]()
+    {
+        pinCurrentThread(cfg.layout[Stage::Inference]);
+        TRACE_THREAD("net load");
+        StartupTimer t(startup, "net load");
+        return loadNet(cfg, model, netErr);
+    };
+    future<bool> netLoaded = async(launch::async, loadNetTask);
+
+    // Load classes
+    vector<string> classNames;
+    try
+    {
+        StartupTimer t(startup, "classes");
+        classNames = loadClassList(cfg);
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what() << "\n";
+        return 2;
+    }
+    cout << "Loaded " << classNames.size() << " classes\n";
+
+    // Anchors for raw per-stride heads (only used if the model exports them)
+    // and optional ROI zones
+    Detector detector;
+    detector.anchors = defaultAnchorConfig();
+    try
+    {
+        if (!cfg.anchorsPath.empty())
+            detector.anchors = loadAnchorConfig(cfg.anchorsPath);
+        if (!cfg.zonesPath.empty())
+        {
+            detector.zones.load(cfg.zonesPath);
+            cout << "Loaded " << detector.zones.size() << " zones from " << cfg.zonesPath << "\n";
+        }
+    }
+    catch (const exception &e)
+    {
+        cerr << e.what() << "\n";
+        return 2;
+    }
+
+    // Open source
+    const bool isCamera = cfg.source.size() == 1 && isdigit(cfg.source[0]);
+    if (cfg.offline && isCamera)
+    {
+        cerr << "ERROR: --offline needs a video file, not a camera\n";
+        return 1;
+    }
+    VideoCapture cap;
+    {
+        StartupTimer t(startup, "source open");
+        if (isCamera)
+            cap.open(stoi(cfg.source), CAP_V4L2);
+        else
+            cap.open(cfg.source, cfg.offline ? CAP_FFMPEG : CAP_V4L2);
+        if (!cap.isOpened())
+        {
+            cerr << "ERROR: cannot open source: " << cfg.source << "\n";
+            return 3;
+        }
+        cap.set(CAP_PROP_FRAME_WIDTH, 1280);
+        cap.set(CAP_PROP_FRAME_HEIGHT, 720);
+        cap.set(CAP_PROP_FOURCC, VideoWriter::fourcc('M', 'J', 'P', 'G'));
+    }
+
+    // Optional writer
+    VideoWriter writer;
+    bool save = false;
+    if (!cfg.savePath.empty())
+    {
+        int fourcc = VideoWriter::fourcc('m', 'p', '4', 'v');
+        double fps = cap.get(CAP_PROP_FPS);
+        if (fps <= 0)
             fps = 25.0;
         Mat probe;
-        cap >> probe;
+        {
+            StartupTimer t(startup, "writer probe");
+            cap >> probe;
+        }
         if (probe.empty())
         {
             cerr << "ERROR: empty first frame\n";
@@ -615,62 +1891,341 @@ int main(int argc, char **argv)
         cout << "Saving to: " << cfg.savePath << "\n";
     }
 
-    cout << "Running. Press 'q' or ESC to quit.\n";
-    TickMeter tm;
-    static bool printedShape = false;
+    // Optional mask RLE output
+    ofstream rleOut;
+    if (!cfg.rlePath.empty())
+    {
+        rleOut.open(cfg.rlePath);
+        if (!rleOut.is_open())
+        {
+            cerr << "ERROR: cannot open RLE output: " << cfg.rlePath << "\n";
+            return 6;
+        }
+        cout << "Writing mask RLE to: " << cfg.rlePath << "\n";
+    }
 
-    // For expected class count detection in parser
-    const int expectedNumClasses = (int)classNames.size();
+    if (!netLoaded.get())
+    {
+        cerr << "ERROR: " << netErr << "\n";
+        return 4;
+    }
+    model.classNames = move(classNames);
 
-    for (;;)
+#ifdef YOLO_WITH_GAPI
+    if (cfg.engine == "gapi")
     {
-        Mat frame;
-        cap >> frame;
-        if (frame.empty())
-            break;
+        // The graph covers capture -> detect -> draw/save/--rle; the rest is
+        // loop-engine only
+        if (cfg.offline || cfg.targetLatencyMs > 0 || cfg.detectEvery > 1 || !cfg.shmName.empty() ||
+            cfg.http.port > 0 || !cfg.modelControl.empty())
+            cerr << "Warning: --offline, --target-latency, --detect-every, --shm, --http and --model-control "
+                    "are ignored with --engine gapi\n";
+        pinner.enter(Stage::Inference);
+        {
+            StartupTimer t(startup, "warm-up");
+            string err;
+            if (!warmUp(model, detector.zones.size(), detector.anchors, err))
+            {
+                cerr << "ERROR: " << err << "\n";
+                return 4;
+            }
+        }
+        applyModel(detector, model);
+        printLayout(cfg.layout, getNumThreads(), cout);
+        signal(SIGINT, onSignal);
+        signal(SIGTERM, onSignal);
+        int rc = runGapiEngine(detector, cfg, model, cap, writer, rleOut, startup);
+        if (!cfg.tracePath.empty())
+            trace::dump(cfg.tracePath);
+        return rc;
+    }
+#endif
 
-        Vec4i pad;
-        float scale = 1.f;
-        Mat in = letterbox(frame, cfg.inputW, cfg.inputH, pad, scale);
+    // Offline: workers decode ahead, the capture thread just hands frames on
+    // in file order. Worker threads inherit the capture stage's CPUs.
+    SegmentedReader segReader;
+    if (cfg.offline)
+    {
+        pinner.enter(Stage::Capture);
+        if (!segReader.open(cfg.source, cfg.decode))
+        {
+            cerr << "ERROR: cannot open source: " << cfg.source << "\n";
+            return 3;
+        }
+        pinner.enter(Stage::Inference);
+        cap.release();
+        cout << "Offline decode: " << segReader.numChunks() << " chunks"
+             << (segReader.keyframeAligned() ? " (keyframe-aligned)" : "") << ", "
+             << min(cfg.decode.workers, segReader.numChunks()) << " workers\n";
+    }
+
+    // Capture and writer run on their own (pinnable) threads
+    BoundedQueue<CapturedFrame> frames(2);
+    BoundedQueue<CapturedFrame> toWrite(4);
+    auto captureLoop = [&]()
+    {
+        pinCurrentThread(cfg.layout[Stage::Capture]);
+        TRACE_THREAD("capture");
+        for (long n = 0;; ++n)
+        {
+            CapturedFrame f;
+            TRACE_FRAME(n);
+            const int64 t0 = getTickCount();
+            {
+                TRACE_SPAN("capture");
+                if (cfg.offline)
+                    segReader.read(f.image);
+                else
+                    cap >> f.image;
+            }
+            f.captureTick = getTickCount();
+            f.index = n;
+            if (n == 0)
+                recordPhase(startup, "first capture", t0);
+            if (f.image.empty() || !frames.push(f))
+                break;
+        }
+        frames.close();
+    };
+    thread capThread(captureLoop);
+    thread writerThread;
+    if (save)
+        writerThread = thread(writerLoop, ref(toWrite), ref(writer), cref(cfg.layout[Stage::Writer]));
+    auto stopPipeline = [&]()
+    {
+        frames.close();
+        capThread.join();
+        segReader.close();
+        toWrite.close();
+        if (writerThread.joinable())
+            writerThread.join();
+    };
 
-        Mat blob = dnn::blobFromImage(in, 1.0 / 255.0, Size(cfg.inputW, cfg.inputH),
-                                      Scalar(), /*swapRB=*/true, /*crop=*/false);
+    // Warm up every input size while the first frames are already captured
+    pinner.enter(Stage::Inference);
+    {
+        StartupTimer t(startup, "warm-up");
+        string err;
+        if (!warmUp(model, detector.zones.size(), detector.anchors, err))
+        {
+            cerr << "ERROR: " << err << "\n";
+            stopPipeline();
+            return 4;
+        }
+    }
+    applyModel(detector, model);
+    printLayout(cfg.layout, getNumThreads(), cout);
+    // A camera kept delivering during warm-up; whatever it queued since is
+    // stale, so the first detection starts on a frame captured after this
+    const int64 warmedUpTick = getTickCount();
 
-        tm.start();
-        net.setInput(blob);
-        vector<Mat> outs;
-        net.forward(outs);
-        tm.stop();
+    ControllerBounds bounds;
+    bounds.targetMs = cfg.targetLatencyMs;
+    bounds.numSizes = (int)model.sizes.size();
+    bounds.baseDetectEvery = cfg.detectEvery;
+    bounds.maxDetectEvery = max(cfg.detectEvery, cfg.adaptMaxEvery);
+    bounds.maxCandidates = cfg.maxCandidates;
+    bounds.minCandidates = cfg.adaptMinCandidates;
+    if (cfg.offline && bounds.targetMs > 0)
+    {
+        cerr << "Warning: --target-latency is ignored with --offline (every frame is processed)\n";
+        bounds.targetMs = 0;
+    }
+    LatencyController controller(bounds);
+    if (controller.enabled())
+        cout << "Latency target " << cfg.targetLatencyMs << " ms, " << controller.numLevels()
+             << " quality levels, " << model.sizes.size() << " input sizes\n";
 
-        Mat out = outs.empty() ? net.forward() : outs[0];
+    // Shared-memory ring, sized from the first frame
+    ShmPublisher shm;
 
-        if (!printedShape)
+    PreviewServer preview;
+    if (cfg.http.port > 0)
+    {
+        if (!preview.start(cfg.http))
         {
-            cerr << "[DNN] out.dims=" << out.dims << " sizes=";
-            for (int i = 0; i < out.dims; ++i)
-                cerr << out.size[i] << " ";
-            cerr << " type=" << out.type() << " (CV_32F is 5)\n";
-            printedShape = true;
+            cerr << "ERROR: cannot listen on " << cfg.http.bindAddr << ":" << cfg.http.port << "\n";
+            stopPipeline();
+            return 7;
         }
+        cout << "Preview: http://" << cfg.http.bindAddr << ":" << cfg.http.port << "/  (/stream, /detections)\n";
+    }
+    // /detections serializes on the server thread; share the names instead
+    // of copying them into every frame's snapshot
+    auto previewNames = make_shared<const vector<string>>(model.classNames);
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    signal(SIGHUP, onReloadSignal);
 
-        vector<Rect> boxes;
-        vector<float> scores;
-        vector<int> classIds;
-        parseDetectionsRobust(out, cfg.confThr, boxes, scores, classIds,
-                              frame.cols, frame.rows, scale, pad, cfg.inputW, cfg.inputH,
-                              expectedNumClasses, /*debug=*/false);
+    // Hot-swap: a replacement model is loaded and warmed up on its own thread
+    // while this loop keeps going on the current one, then swapped in between
+    // two frames. Its warm-up forwards take turns with this loop's (see
+    // g_forwardMutex): a live frame may wait for one of them, but never runs
+    // without the thread pool. `previous` is kept until the new model has run
+    // once, so a model that loads but fails on real frames is rolled back.
+    const size_t numZones = detector.zones.size();
+    auto loadInBackground = [&cfg, numZones, anchors = detector.anchors](YoloConfig spec) -> unique_ptr<LoadedModel>
+    {
+        pinCurrentThread(cfg.layout[Stage::Postprocess]);
+        TRACE_THREAD("loader");
+        TRACE_SPAN("modelLoad");
+        auto m = make_unique<LoadedModel>();
+        string err;
+        try
+        {
+            m->classNames = loadClassList(spec);
+        }
+        catch (const exception &e)
+        {
+            err = e.what();
+        }
+        if (err.empty() && !loadModel(spec, numZones, anchors, *m, err))
+            m.reset();
+        if (!err.empty())
+        {
+            cerr << "[model] reload failed: " << err << "; keeping current model\n";
+            return nullptr;
+        }
+        return m;
+    };
+    future<unique_ptr<LoadedModel>> pendingModel;
+    unique_ptr<LoadedModel> previous;
+    int64 nextControlPoll = 0;
+    auto swapModel = [&](LoadedModel &&next)
+    {
+        const size_t oldSizes = model.sizes.size();
+        model = move(next);
+        applyModel(detector, model);
+        previewNames = make_shared<const vector<string>>(model.classNames);
+        if (model.sizes.size() != oldSizes)
+        {
+            bounds.numSizes = (int)model.sizes.size();
+            controller = LatencyController(bounds);
+        }
+    };
 
-        vector<int> keep;
-        dnn::NMSBoxes(boxes, scores, cfg.confThr, cfg.iouThr, keep);
+    cout << "Running. Press 'q' or ESC to quit.\n";
+    TickMeter tm;
 
-        for (int i : keep)
+    vector<Detection> dets; // last result, redrawn on frames the net skips
+    double fps = 0;
+    vector<double> latencies;
+    long staleDropped = 0;
+    const int64 startTick = getTickCount();
+    for (long frameId = 0;; ++frameId)
+    {
+        CapturedFrame captured;
+        bool got = frames.pop(captured);
+        while (got && frameId == 0 && isCamera && captured.captureTick < warmedUpTick)
         {
-            if (i < 0 || i >= (int)boxes.size())
-                continue;
-            int cid = (i < (int)classIds.size()) ? classIds[i] : 0;
-            string label = (cid >= 0 && cid < (int)classNames.size()) ? classNames[cid] : ("id_" + to_string(cid));
-            drawDet(frame, boxes[i], label, scores[i], classColor(cid));
+            ++staleDropped;
+            got = frames.pop(captured);
+        }
+        if (!got)
+            break;
+        Mat &frame = captured.image;
+        // Tag by capture index: stale warm-up frames dropped above never
+        // reach frameId, but the capture thread counted them
+        TRACE_FRAME(captured.index);
+        TRACE_SPAN("frame");
+
+        // Model hot-swap: start a load on SIGHUP or a control file change
+        // (polled once a second), swap it in once it is warm
+        if (!pendingModel.valid())
+        {
+            bool reload = g_reload != 0;
+            if (!cfg.modelControl.empty() && getTickCount() >= nextControlPoll)
+            {
+                nextControlPoll = getTickCount() + (int64)getTickFrequency();
+                int64 stamp = fileStamp(cfg.modelControl);
+                reload |= stamp != controlStamp && stamp != 0;
+                controlStamp = stamp;
+            }
+            if (reload)
+            {
+                g_reload = 0;
+                YoloConfig spec = model.spec;
+                string err;
+                if (!cfg.modelControl.empty() && !readModelControl(cfg.modelControl, spec, err))
+                    cerr << "[model] " << err << "; keeping current model\n";
+                else
+                {
+                    cout << "[model] loading " << spec.onnxPath << " (" << spec.inputW << "x" << spec.inputH
+                         << ") in the background\n";
+                    pendingModel = async(launch::async, loadInBackground, spec);
+                }
+            }
         }
+        else if (pendingModel.wait_for(chrono::seconds(0)) == future_status::ready)
+        {
+            unique_ptr<LoadedModel> next = pendingModel.get();
+            if (next)
+            {
+                cout << "[model] frame " << frameId << ": swapped " << model.spec.onnxPath << " -> "
+                     << next->spec.onnxPath << " (" << next->classNames.size() << " classes)\n";
+                previous = make_unique<LoadedModel>(move(model));
+                swapModel(move(*next));
+                dets.clear();
+            }
+        }
+
+        // Fixed settings, or whatever the controller currently allows
+        QualityLevel q;
+        q.detectEvery = cfg.detectEvery;
+        q.maxCandidates = cfg.maxCandidates;
+        if (controller.enabled())
+            q = controller.level();
+
+        if (frameId % q.detectEvery == 0)
+        {
+            try
+            {
+                dets = detectFrame(detector, cfg, frame, model.sizes[q.sizeIdx], q.maxCandidates, pinner, tm);
+                fps = 1e3 / tm.getTimeMilli();
+                previous.reset();
+                if (frameId == 0)
+                    printStartupReport(startup, cout,
+                                       (getTickCount() - captured.captureTick) * 1e3 / getTickFrequency(),
+                                       staleDropped);
+            }
+            catch (const cv::Exception &e)
+            {
+                if (!previous)
+                    throw;
+                cerr << "[model] " << model.spec.onnxPath << " failed on frame " << frameId << ": " << e.what()
+                     << "; rolling back to " << previous->spec.onnxPath << "\n";
+                swapModel(move(*previous));
+                previous.reset();
+                dets.clear();
+            }
+            tm.reset();
+        }
+        if (!cfg.shmName.empty() && !shm.isOpen())
+        {
+            if (shm.open(cfg.shmName, cfg.shmSlots, frame.total() * frame.elemSize()))
+                cout << "Publishing to /dev/shm/" << cfg.shmName << " (" << cfg.shmSlots << " slots)\n";
+            else
+            {
+                cerr << "Warning: cannot create shared memory ring " << cfg.shmName << "\n";
+                cfg.shmName.clear();
+            }
+        }
+        if (shm.isOpen() && !cfg.shmAnnotated)
+            shm.publish(frame, frameId, false, toDetRecords(dets));
+
+        if (!detector.zones.empty())
+            detector.zones.draw(frame);
+
+        if (rleOut.is_open())
+            rleOut << detectionsJson(frameId, frame.size(), dets, model.classNames) << "\n";
+        if (preview.running())
+        {
+            // Masks are shared, not copied; nothing writes to them after detection
+            auto snapshot = make_shared<const vector<Detection>>(dets);
+            preview.setDetections([snapshot, names = previewNames, frameId, size = frame.size()]()
+                                  { return detectionsJson(frameId, size, *snapshot, *names); });
+        }
+        drawDetections(frame, dets, model.classNames);
 
         // if (!keep.empty() && !classIds.empty()) {
         //     int idx = keep[0];
@@ -681,18 +2236,48 @@ int main(int argc, char **argv)
         //     }
         // }
 
-        double fps = 1e3 / tm.getTimeMilli();
-        tm.reset();
-        putText(frame, format("FPS: %.1f", fps), Point(10, 30), FONT_HERSHEY_SIMPLEX, 0.9, Scalar(0, 0, 0), 3);
-        putText(frame, format("FPS: %.1f", fps), Point(10, 30), FONT_HERSHEY_SIMPLEX, 0.9, Scalar(255, 255, 255), 1);
+        drawFps(frame, fps);
+
+        if (shm.isOpen() && cfg.shmAnnotated)
+            shm.publish(frame, frameId, true, toDetRecords(dets));
+
+        // Encoded on the server's thread, and only if someone is watching
+        preview.offerFrame(frame);
 
-        imshow("YOLOv11 - OpenCV DNN (fixed)", frame);
+        if (cfg.display)
+        {
+            TRACE_SPAN("display");
+            imshow("YOLOv11 - OpenCV DNN (fixed)", frame);
+        }
         if (save)
-            writer << frame;
+            toWrite.push(captured);
 
+        double latencyMs = (getTickCount() - captured.captureTick) * 1e3 / getTickFrequency();
+        latencies.push_back(latencyMs);
+        if (controller.update(latencyMs))
+        {
+            const QualityLevel &nq = controller.level();
+            cout << "[slo] frame " << frameId << ": " << controller.lastReason() << " -> level "
+                 << controller.levelIndex() << "/" << controller.numLevels() - 1 << " (" << nq << ", input "
+                 << model.sizes[nq.sizeIdx].width << "x" << model.sizes[nq.sizeIdx].height << ")\n";
+        }
+
+        if (!cfg.tracePath.empty() && trace::dumpRequested())
+            trace::dump(cfg.tracePath);
+
+        if (g_stop)
+            break;
+        if (!cfg.display)
+            continue;
+        TRACE_SPAN("waitKey");
         int key = waitKey(1);
         if (key == 27 || key == 'q' || key == 'Q')
             break;
     }
+
+    stopPipeline();
+    printBenchmark("loop", (getTickCount() - startTick) / getTickFrequency(), latencies);
+    if (!cfg.tracePath.empty())
+        trace::dump(cfg.tracePath);
     return 0;
 }
@@ -0,0 +1,249 @@
+#include "mjpeg_server.hpp"
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+using namespace cv;
+using namespace std;
+
+static int64_t steadyNs()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool sendAll(int fd, const void *data, size_t n)
+{
+    const char *p = static_cast<const char *>(data);
+    while (n > 0)
+    {
+        ssize_t k = ::send(fd, p, n, MSG_NOSIGNAL);
+        if (k <= 0)
+            return false;
+        p += k;
+        n -= (size_t)k;
+    }
+    return true;
+}
+
+static bool sendAll(int fd, const string &s)
+{
+    return sendAll(fd, s.data(), s.size());
+}
+
+static void setTimeout(int fd, int opt, int seconds)
+{
+    timeval tv{seconds, 0};
+    setsockopt(fd, SOL_SOCKET, opt, &tv, sizeof(tv));
+}
+
+bool PreviewServer::start(const Options &opt)
+{
+    stop();
+    opt_ = opt;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return false;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)opt.port);
+    if (inet_pton(AF_INET, opt.bindAddr.c_str(), &addr.sin_addr) != 1 ||
+        ::bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    listenFd_ = fd;
+    running_ = true;
+    acceptThread_ = thread(&PreviewServer::acceptLoop, this);
+    encodeThread_ = thread(&PreviewServer::encodeLoop, this);
+    return true;
+}
+
+void PreviewServer::stop()
+{
+    if (!running_.exchange(false))
+        return;
+    ::shutdown(listenFd_, SHUT_RDWR); // unblocks accept()
+    acceptThread_.join();
+    ::close(listenFd_);
+    listenFd_ = -1;
+    {
+        lock_guard<mutex> lk(m_);
+        for (int fd : clientFds_)
+            ::shutdown(fd, SHUT_RDWR);
+    }
+    pendingCv_.notify_all();
+    jpegCv_.notify_all();
+    encodeThread_.join();
+
+    // Client threads are detached; wait for the last one to leave
+    unique_lock<mutex> lk(m_);
+    clientsCv_.wait(lk, [&]
+                    { return clientFds_.empty(); });
+}
+
+bool PreviewServer::wantsFrame() const
+{
+    return running_ && streamClients_ > 0 && steadyNs() >= nextDueNs_;
+}
+
+void PreviewServer::offerFrame(const Mat &frame)
+{
+    if (!wantsFrame())
+        return;
+    nextDueNs_ = steadyNs() + (int64_t)(1e9 / max(opt_.fps, 0.1));
+    {
+        lock_guard<mutex> lk(m_);
+        pending_ = frame; // latest wins if the encoder is still busy
+    }
+    pendingCv_.notify_one();
+}
+
+void PreviewServer::setDetections(function<string()> toJson)
+{
+    lock_guard<mutex> lk(m_);
+    detJson_ = move(toJson);
+}
+
+void PreviewServer::encodeLoop()
+{
+    const vector<int> params{IMWRITE_JPEG_QUALITY, opt_.quality};
+    for (;;)
+    {
+        Mat frame;
+        {
+            unique_lock<mutex> lk(m_);
+            pendingCv_.wait(lk, [&]
+                            { return !running_ || !pending_.empty(); });
+            if (!running_)
+                return;
+            swap(frame, pending_);
+        }
+
+        // Fit inside the preview size, keeping aspect
+        double r = min((double)opt_.size.width / frame.cols, (double)opt_.size.height / frame.rows);
+        Mat small = frame;
+        if (r < 1.0)
+            resize(frame, small, Size((int)(frame.cols * r), (int)(frame.rows * r)), 0, 0, INTER_AREA);
+
+        auto buf = make_shared<vector<unsigned char>>();
+        if (!imencode(".jpg", small, *buf, params))
+            continue;
+        {
+            lock_guard<mutex> lk(m_);
+            jpeg_ = buf;
+            ++jpegSeq_;
+        }
+        jpegCv_.notify_all();
+    }
+}
+
+void PreviewServer::acceptLoop()
+{
+    while (running_)
+    {
+        int fd = accept(listenFd_, nullptr, nullptr);
+        if (fd < 0)
+            continue; // listen socket shut down by stop(), or a transient error
+        {
+            lock_guard<mutex> lk(m_);
+            if (!running_ || (int)clientFds_.size() >= opt_.maxClients)
+            {
+                ::close(fd);
+                continue;
+            }
+            clientFds_.insert(fd);
+        }
+        thread(&PreviewServer::serveClient, this, fd).detach();
+    }
+}
+
+void PreviewServer::serveClient(int fd)
+{
+    setTimeout(fd, SO_RCVTIMEO, 2);
+    setTimeout(fd, SO_SNDTIMEO, 5); // a stuck viewer gets dropped, never waited on
+
+    string req;
+    char buf[1024];
+    while (req.find("\r\n\r\n") == string::npos && req.size() < 8192)
+    {
+        ssize_t k = recv(fd, buf, sizeof(buf), 0);
+        if (k <= 0)
+            break;
+        req.append(buf, (size_t)k);
+    }
+    string path;
+    if (req.rfind("GET ", 0) == 0)
+        path = req.substr(4, req.find(' ', 4) - 4);
+
+    if (path == "/stream")
+        serveStream(fd);
+    else if (path == "/detections")
+    {
+        function<string()> toJson;
+        {
+            lock_guard<mutex> lk(m_);
+            toJson = detJson_;
+        }
+        const string body = toJson ? toJson() : "{}";
+        sendAll(fd, "HTTP/1.0 200 OK\r\nContent-Type: application/json\r\nCache-Control: no-cache\r\n"
+                    "Content-Length: " +
+                        to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body);
+    }
+    else if (path == "/")
+    {
+        const string body = "<html><body style=\"margin:0;background:#000\">"
+                            "<img src=\"/stream\" style=\"width:100%\"></body></html>";
+        sendAll(fd, "HTTP/1.0 200 OK\r\nContent-Type: text/html\r\nContent-Length: " +
+                        to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body);
+    }
+    else
+        sendAll(fd, string("HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"));
+
+    // Close under m_: once the number is free, accept() may hand it to a new
+    // client, and stop() must never shut down an fd it does not own
+    lock_guard<mutex> lk(m_);
+    clientFds_.erase(fd);
+    ::close(fd);
+    clientsCv_.notify_all();
+}
+
+void PreviewServer::serveStream(int fd)
+{
+    if (!sendAll(fd, string("HTTP/1.0 200 OK\r\nContent-Type: multipart/x-mixed-replace; boundary=frame\r\n"
+                            "Cache-Control: no-cache\r\nConnection: close\r\n\r\n")))
+        return;
+
+    ++streamClients_;
+    uint64_t seen = 0;
+    for (;;)
+    {
+        shared_ptr<const vector<unsigned char>> jpeg;
+        {
+            unique_lock<mutex> lk(m_);
+            jpegCv_.wait(lk, [&]
+                         { return !running_ || jpegSeq_ > seen; });
+            if (!running_)
+                break;
+            jpeg = jpeg_;
+            seen = jpegSeq_; // anything published while we were sending is skipped
+        }
+        string part = "--frame\r\nContent-Type: image/jpeg\r\nContent-Length: " + to_string(jpeg->size()) + "\r\n\r\n";
+        if (!sendAll(fd, part) || !sendAll(fd, jpeg->data(), jpeg->size()) || !sendAll(fd, "\r\n", 2))
+            break;
+    }
+    --streamClients_;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ======================= MJPEG preview server =======================
+// Tiny HTTP/1.0 server for headless hosts:
+//   GET /            minimal viewer page
+//   GET /stream      multipart/x-mixed-replace MJPEG
+//   GET /detections  latest detections as JSON
+//
+// Each offered frame is JPEG-encoded at most once, on the server's own
+// thread, and the same buffer is sent to every client. Clients always get
+// the newest frame; a slow client skips frames instead of holding anything
+// up. Nothing is encoded while no one is watching, and detections are only
+// turned into JSON when /detections is actually requested.
+class PreviewServer
+{
+public:
+    struct Options
+    {
+        std::string bindAddr = "127.0.0.1";
+        int port = 0; // 0 = server off
+        cv::Size size = cv::Size(640, 360); // preview fits inside this
+        double fps = 10.0;                  // max encode rate
+        int quality = 75;
+        int maxClients = 16;
+    };
+
+    PreviewServer() = default;
+    ~PreviewServer() { stop(); }
+    PreviewServer(const PreviewServer &) = delete;
+    PreviewServer &operator=(const PreviewServer &) = delete;
+
+    bool start(const Options &opt);
+    void stop();
+    bool running() const { return running_; }
+
+    // True if a stream client is connected and the preview rate allows
+    // another frame now; lets the caller skip work for frames we'd drop.
+    bool wantsFrame() const;
+    // Hand over a frame (shared, not copied); it must not be modified after.
+    void offerFrame(const cv::Mat &frame);
+    // Latest detections as a serializer, run on a server thread only when
+    // /detections is requested; it must own (or share) everything it reads.
+    void setDetections(std::function<std::string()> toJson);
+
+private:
+    void acceptLoop();
+    void encodeLoop();
+    void serveClient(int fd);
+    void serveStream(int fd);
+
+    Options opt_;
+    std::atomic<bool> running_{false};
+    int listenFd_ = -1;
+    std::thread acceptThread_, encodeThread_;
+
+    mutable std::mutex m_;
+    std::condition_variable pendingCv_, jpegCv_, clientsCv_;
+    cv::Mat pending_;
+    std::shared_ptr<const std::vector<unsigned char>> jpeg_;
+    uint64_t jpegSeq_ = 0;
+    std::function<std::string()> detJson_;
+    std::set<int> clientFds_;
+    std::atomic<int> streamClients_{0};
+    std::atomic<int64_t> nextDueNs_{0};
+};
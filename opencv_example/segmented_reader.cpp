@@ -0,0 +1,230 @@
+#include "segmented_reader.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace cv;
+using namespace std;
+
+bool SegmentedReader::open(const string &path, const Options &opt)
+{
+    close();
+    path_ = path;
+    opt_ = opt;
+    opt_.workers = max(1, opt_.workers);
+    opt_.minChunkFrames = max(1, opt_.minChunkFrames);
+
+    probe();
+    if (chunks_.empty())
+        return false;
+
+    stop_ = false;
+    sequential_ = false;
+    nextChunk_ = curChunk_ = emitted_ = 0;
+    curPos_ = 0;
+    bufferedBytes_ = 0;
+    prevSeam_.release();
+    int n = min(opt_.workers, (int)chunks_.size());
+    for (int i = 0; i < n; ++i)
+        workers_.emplace_back(&SegmentedReader::workerLoop, this);
+    return true;
+}
+
+void SegmentedReader::close()
+{
+    stopWorkers();
+    ready_.clear();
+    chunks_.clear();
+    seqCap_.release();
+}
+
+// Find keyframes by walking packets without decoding them (FFmpeg raw mode),
+// then group GOPs into chunks of at least minChunkFrames.
+void SegmentedReader::probe()
+{
+    chunks_.clear();
+    keyframeAligned_ = false;
+
+    VideoCapture cap(path_, CAP_FFMPEG);
+    if (!cap.isOpened())
+        return;
+    frameCount_ = (int)cap.get(CAP_PROP_FRAME_COUNT);
+
+    vector<int> starts;
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 6)
+    if (cap.set(CAP_PROP_FORMAT, -1))
+    {
+        int i = 0;
+        while (cap.grab())
+        {
+            if (cap.get(CAP_PROP_LRF_HAS_KEY_FRAME) != 0)
+                starts.push_back(i);
+            ++i;
+        }
+        if (i > 0)
+            frameCount_ = i;
+        keyframeAligned_ = !starts.empty();
+    }
+#endif
+    // No keyframe info: fixed-size chunks. The FFmpeg backend still seeks
+    // exactly (it decodes forward from the previous keyframe), just slower.
+    if (starts.empty())
+        for (int i = 0; i < frameCount_; i += opt_.minChunkFrames)
+            starts.push_back(i);
+
+    int start = 0;
+    for (int k : starts)
+        if (k - start >= opt_.minChunkFrames)
+        {
+            chunks_.push_back({start, k});
+            start = k;
+        }
+    chunks_.push_back({start, -1});
+}
+
+void SegmentedReader::workerLoop()
+{
+    TRACE_THREAD("decode");
+    VideoCapture cap(path_, CAP_FFMPEG);
+    // Stay within a few chunks of the reader so decoded frames don't pile up
+    const int window = opt_.workers * 2;
+    const size_t maxBytes = max<size_t>(opt_.maxBufferedMB, 1) << 20;
+    for (;;)
+    {
+        int c;
+        {
+            unique_lock<mutex> lk(m_);
+            consumed_.wait(lk, [&]
+                           { return stop_ || nextChunk_ >= (int)chunks_.size() || nextChunk_ < curChunk_ + window; });
+            if (stop_ || nextChunk_ >= (int)chunks_.size())
+                return;
+            c = nextChunk_++;
+            ready_[c];
+        }
+
+        const Chunk ch = chunks_[c];
+        if (cap.isOpened() && ch.start > 0)
+            cap.set(CAP_PROP_POS_FRAMES, ch.start);
+        for (int i = ch.start; cap.isOpened() && (ch.end < 0 || i <= ch.end); ++i)
+        {
+            Mat f;
+            TRACE_FRAME(i);
+            {
+                TRACE_SPAN("decode");
+                if (!cap.read(f) || f.empty())
+                    break;
+            }
+            const size_t bytes = f.total() * f.elemSize();
+            unique_lock<mutex> lk(m_);
+            // Long GOPs at high resolution make chunks huge: wait for the
+            // reader unless this is the chunk it is waiting on
+            consumed_.wait(lk, [&]
+                           { return stop_ || c <= curChunk_ || bufferedBytes_ + bytes <= maxBytes; });
+            if (stop_)
+                return;
+            ChunkFrames &cf = ready_[c];
+            if (ch.end < 0 || i < ch.end)
+            {
+                cf.frames.push_back(f);
+                bufferedBytes_ += bytes;
+            }
+            else
+                cf.seam = f;
+            produced_.notify_all();
+        }
+        lock_guard<mutex> lk(m_);
+        ready_[c].done = true;
+        produced_.notify_all();
+    }
+}
+
+void SegmentedReader::stopWorkers()
+{
+    {
+        lock_guard<mutex> lk(m_);
+        stop_ = true;
+    }
+    produced_.notify_all();
+    consumed_.notify_all();
+    for (thread &t : workers_)
+        t.join();
+    workers_.clear();
+}
+
+bool SegmentedReader::fallBackToSequential(int frameIndex, const char *why)
+{
+    cerr << "Warning: " << why << " in " << path_ << " at frame " << frameIndex
+         << "; continuing with sequential decode\n";
+    stopWorkers();
+    ready_.clear();
+    bufferedBytes_ = 0;
+    seqCap_.open(path_, CAP_FFMPEG);
+    for (int i = 0; i < frameIndex && seqCap_.isOpened(); ++i)
+        if (!seqCap_.grab())
+            break;
+    sequential_ = true;
+    return seqCap_.isOpened();
+}
+
+bool SegmentedReader::read(Mat &frame)
+{
+    if (sequential_)
+    {
+        if (!seqCap_.read(frame) || frame.empty())
+            return false;
+        ++emitted_;
+        return true;
+    }
+
+    unique_lock<mutex> lk(m_);
+    for (;;)
+    {
+        if (curChunk_ >= (int)chunks_.size())
+            return false;
+        produced_.wait(lk, [&]
+                       {
+            auto it = ready_.find(curChunk_);
+            return it != ready_.end() && (it->second.frames.size() > curPos_ || it->second.done); });
+
+        ChunkFrames &cf = ready_[curChunk_];
+        if (curPos_ < cf.frames.size())
+        {
+            frame = cf.frames[curPos_];
+            cf.frames[curPos_].release(); // `frame` now holds the only reference
+            bufferedBytes_ -= frame.total() * frame.elemSize();
+            consumed_.notify_all();
+            const bool seamCheck = (curPos_ == 0 && curChunk_ > 0);
+            ++curPos_;
+            if (seamCheck)
+            {
+                bool same = !prevSeam_.empty() && prevSeam_.size() == frame.size() &&
+                            prevSeam_.type() == frame.type() && norm(prevSeam_, frame, NORM_INF) == 0;
+                prevSeam_.release();
+                if (!same)
+                {
+                    lk.unlock();
+                    return fallBackToSequential(emitted_, "seek is not frame-exact") && read(frame);
+                }
+            }
+            ++emitted_;
+            return true;
+        }
+
+        // Chunk fully consumed. Only the last one may end early; any other
+        // chunk stopping short means its worker failed, not end of file.
+        const Chunk &ch = chunks_[curChunk_];
+        if (ch.end < 0)
+            return false;
+        if ((int)cf.frames.size() < ch.end - ch.start || cf.seam.empty())
+        {
+            lk.unlock();
+            return fallBackToSequential(emitted_, "chunk decode stopped short") && read(frame);
+        }
+        prevSeam_ = cf.seam;
+        ready_.erase(curChunk_);
+        ++curChunk_;
+        curPos_ = 0;
+        consumed_.notify_all();
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ======================= Parallel segmented file decode =======================
+// Splits a video file into keyframe-aligned chunks and decodes them on
+// several workers, each with its own VideoCapture, while read() hands frames
+// back strictly in file order. Workers only run a few chunks ahead of the
+// reader, and stop decoding once the decoded-but-unread frames reach
+// maxBufferedMB (the chunk the reader is in is exempt, so it always drains).
+//
+// Every worker decodes one frame past its chunk end; the reader compares it
+// with the first frame of the next chunk. If a seek was not frame-exact the
+// two differ, and the reader falls back to plain sequential decoding from
+// that point, so the output always matches a sequential run. A chunk that
+// comes back short (a worker failed to open or read the file) takes the same
+// fallback; only the last chunk may end early.
+class SegmentedReader
+{
+public:
+    struct Options
+    {
+        int workers = 4;
+        int minChunkFrames = 64; // merge GOPs until a chunk has at least this many frames
+        size_t maxBufferedMB = 1024; // decoded frames waiting for read(), all workers together
+    };
+
+    SegmentedReader() = default;
+    ~SegmentedReader() { close(); }
+    SegmentedReader(const SegmentedReader &) = delete;
+    SegmentedReader &operator=(const SegmentedReader &) = delete;
+
+    bool open(const std::string &path, const Options &opt);
+    void close();
+
+    // Next frame in file order; false at end of file
+    bool read(cv::Mat &frame);
+
+    int numChunks() const { return (int)chunks_.size(); }
+    int frameCount() const { return frameCount_; }
+    bool keyframeAligned() const { return keyframeAligned_; }
+    bool fellBack() const { return sequential_; }
+
+private:
+    struct Chunk
+    {
+        int start = 0;
+        int end = -1; // exclusive; -1 = until end of file
+    };
+    struct ChunkFrames
+    {
+        std::vector<cv::Mat> frames;
+        cv::Mat seam; // first frame after `end`, decoded by the same worker
+        bool done = false;
+    };
+
+    void probe();
+    void workerLoop();
+    void stopWorkers();
+    bool fallBackToSequential(int frameIndex, const char *why);
+
+    std::string path_;
+    Options opt_;
+    std::vector<Chunk> chunks_;
+    int frameCount_ = 0;
+    bool keyframeAligned_ = false;
+
+    std::mutex m_;
+    std::condition_variable produced_, consumed_;
+    std::map<int, ChunkFrames> ready_;
+    int nextChunk_ = 0;     // next chunk a worker will take
+    int curChunk_ = 0;      // chunk the reader is in
+    size_t curPos_ = 0;     // next frame within curChunk_
+    int emitted_ = 0;       // frames returned so far
+    size_t bufferedBytes_ = 0; // pixel data in ready_ not yet returned
+    cv::Mat prevSeam_;
+    bool stop_ = false;
+    std::vector<std::thread> workers_;
+
+    bool sequential_ = false;
+    cv::VideoCapture seqCap_;
+};
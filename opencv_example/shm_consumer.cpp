@@ -0,0 +1,105 @@
+// Minimal consumer for the detector's shared-memory ring: attaches to
+// /dev/shm/<name>, prints one line per frame (publish index, frame id,
+// size, detections, age), reattaches when the detector restarts and
+// reports dropped frames on exit.
+#include "shm_reader.hpp"
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <thread>
+
+using namespace std;
+
+static volatile sig_atomic_t g_stop = 0;
+
+static int64_t nowNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        cout << "Usage:\n"
+                "  "
+             << argv[0] << " <shm name> [--latest] [--frames n] [--no-pixels]\n"
+                           "Options:\n"
+                           "  --latest     Only ever read the newest frame (skip backlog)\n"
+                           "  --frames n   Exit after n frames\n"
+                           "  --no-pixels  Read detection records only\n";
+        return 0;
+    }
+    string name = argv[1];
+    bool latest = false, withPixels = true;
+    long maxFrames = -1;
+    for (int i = 2; i < argc; ++i)
+    {
+        string a = argv[i];
+        if (a == "--latest")
+            latest = true;
+        else if (a == "--no-pixels")
+            withPixels = false;
+        else if (a == "--frames" && i + 1 < argc)
+            maxFrames = stol(argv[++i]);
+        else
+        {
+            cerr << "Unknown option: " << a << "\n";
+            return 1;
+        }
+    }
+    signal(SIGINT, [](int)
+           { g_stop = 1; });
+
+    ShmFrameReader reader;
+    auto attach = [&]()
+    {
+        while (!g_stop && !reader.open(name))
+            this_thread::sleep_for(chrono::milliseconds(100));
+        if (!g_stop)
+            cout << "Attached to /dev/shm/" << name << " (" << reader.slotCount() << " slots)\n";
+        return !g_stop;
+    };
+    if (!attach())
+        return 0;
+
+    ShmFrame f;
+    long n = 0;
+    uint64_t dropped = 0;
+    while (!g_stop && (maxFrames < 0 || n < maxFrames))
+    {
+        ShmRead r = latest ? reader.readLatest(f, withPixels) : reader.readNext(f, withPixels);
+        if (r == ShmRead::Closed)
+        {
+            // Detector stopped or restarted: the old mapping will never see
+            // another frame
+            cout << "Publisher closed /dev/shm/" << name << ", waiting for it to come back\n";
+            dropped += reader.dropped();
+            reader.close();
+            if (!attach())
+                break;
+            continue;
+        }
+        if (r != ShmRead::Frame)
+        {
+            this_thread::sleep_for(chrono::milliseconds(1));
+            continue;
+        }
+        ++n;
+        printf("seq=%llu frame=%llu %dx%d%s dets=%zu age=%.1fms",
+               (unsigned long long)f.seq, (unsigned long long)f.frameId, f.width, f.height,
+               f.annotated ? " annotated" : "", f.dets.size(), (nowNs() - f.timestampNs) / 1e6);
+        for (const auto &d : f.dets)
+            printf(" [%d %.2f %d,%d %dx%d]", d.classId, d.score, d.x, d.y, d.w, d.h);
+        printf("\n");
+    }
+    cout << "Read " << n << " frames, dropped " << dropped + reader.dropped() << "\n";
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include "shm_publisher.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace shmring;
+
+bool ShmPublisher::open(const string &name, uint32_t slots, size_t frameBytes)
+{
+    close();
+    if (slots == 0)
+        return false;
+    const string path = "/" + name;
+    const size_t bytes = segmentBytes(slots, frameBytes);
+
+    // Start from a fresh object so a stale, differently sized ring from an
+    // earlier run is never reused in place.
+    shm_unlink(path.c_str());
+    int fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+        return false;
+    if (ftruncate(fd, (off_t)bytes) != 0)
+    {
+        ::close(fd);
+        shm_unlink(path.c_str());
+        return false;
+    }
+    void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+    {
+        shm_unlink(path.c_str());
+        return false;
+    }
+
+    // ftruncate zero-fills: every slot starts at seq 0 (empty)
+    RingHeader *h = static_cast<RingHeader *>(p);
+    h->version = kVersion;
+    h->slotCount = slots;
+    h->slotBytes = slotBytesFor(frameBytes);
+    h->frameCapacity = frameBytes;
+    h->published.store(0, memory_order_relaxed);
+    __atomic_store_n(&h->magic, kMagic, __ATOMIC_RELEASE);
+
+    name_ = name;
+    base_ = p;
+    bytes_ = bytes;
+    hdr_ = h;
+    return true;
+}
+
+void ShmPublisher::close()
+{
+    if (!base_)
+        return;
+    __atomic_store_n(&hdr_->closed, 1u, __ATOMIC_RELEASE);
+    munmap(base_, bytes_);
+    shm_unlink(("/" + name_).c_str());
+    base_ = nullptr;
+    hdr_ = nullptr;
+    bytes_ = 0;
+}
+
+bool ShmPublisher::publish(const cv::Mat &frame, uint64_t frameId, bool annotated,
+                           const vector<DetRecord> &dets)
+{
+    if (!hdr_)
+        return false;
+    const size_t rowBytes = frame.cols * frame.elemSize();
+    if (rowBytes * frame.rows > hdr_->frameCapacity)
+        return false;
+
+    const uint64_t idx = hdr_->published.load(memory_order_relaxed);
+    SlotHeader *s = slotAt(base_, hdr_, idx);
+
+    // Seqlock: odd while writing, readers discard anything they copied meanwhile
+    s->seq.store(2 * idx + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    s->frameId = frameId;
+    s->timestampNs = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    s->width = frame.cols;
+    s->height = frame.rows;
+    s->cvType = frame.type();
+    s->stride = (int32_t)rowBytes;
+    s->annotated = annotated ? 1 : 0;
+    s->numDets = (int32_t)min(dets.size(), (size_t)kMaxDets);
+    memcpy(s->dets, dets.data(), s->numDets * sizeof(DetRecord));
+
+    uint8_t *dst = slotPixels(s);
+    if (frame.isContinuous())
+        memcpy(dst, frame.data, rowBytes * frame.rows);
+    else
+        for (int y = 0; y < frame.rows; ++y)
+            memcpy(dst + y * rowBytes, frame.ptr(y), rowBytes);
+
+    s->seq.store(2 * idx + 2, memory_order_release);
+    hdr_->published.store(idx + 1, memory_order_release);
+    return true;
+}
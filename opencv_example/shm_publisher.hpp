@@ -0,0 +1,37 @@
+#pragma once
+
+#include "shm_ring.hpp"
+
+#include <opencv2/core.hpp>
+
+#include <string>
+#include <vector>
+
+// ======================= Shared-memory ring publisher =======================
+// Writer side of shm_ring.hpp. Never blocks on readers: each publish() fills
+// the next slot and bumps the published counter.
+class ShmPublisher
+{
+public:
+    ShmPublisher() = default;
+    ~ShmPublisher() { close(); }
+    ShmPublisher(const ShmPublisher &) = delete;
+    ShmPublisher &operator=(const ShmPublisher &) = delete;
+
+    // (Re)creates /dev/shm/<name> with `slots` slots of up to frameBytes pixels
+    bool open(const std::string &name, uint32_t slots, size_t frameBytes);
+    bool isOpen() const { return base_ != nullptr; }
+    // Marks the ring closed, unmaps and unlinks; attached readers see
+    // ShmRead::Closed once they have read what was published
+    void close();
+
+    // Frames larger than the slot capacity are skipped (returns false)
+    bool publish(const cv::Mat &frame, uint64_t frameId, bool annotated,
+                 const std::vector<shmring::DetRecord> &dets);
+
+private:
+    std::string name_;
+    void *base_ = nullptr;
+    size_t bytes_ = 0;
+    shmring::RingHeader *hdr_ = nullptr;
+};
@@ -0,0 +1,166 @@
+#include "shm_reader.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace shmring;
+
+bool ShmFrameReader::open(const string &name)
+{
+    close();
+    int fd = shm_open(("/" + name).c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(RingHeader))
+    {
+        ::close(fd);
+        return false;
+    }
+    void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+        return false;
+
+    const RingHeader *h = static_cast<const RingHeader *>(p);
+    uint32_t magic = __atomic_load_n(&h->magic, __ATOMIC_ACQUIRE);
+    if (magic != kMagic || h->version != kVersion || h->slotCount == 0 ||
+        segmentBytes(h->slotCount, h->frameCapacity) > (size_t)st.st_size ||
+        __atomic_load_n(&h->closed, __ATOMIC_ACQUIRE))
+    {
+        munmap(p, st.st_size);
+        return false;
+    }
+    name_ = name;
+    dev_ = st.st_dev;
+    ino_ = st.st_ino;
+    nextInodeCheck_ = chrono::steady_clock::now();
+    base_ = p;
+    bytes_ = st.st_size;
+    hdr_ = h;
+    next_ = published();
+    dropped_ = 0;
+    return true;
+}
+
+void ShmFrameReader::close()
+{
+    if (base_)
+        munmap(base_, bytes_);
+    base_ = nullptr;
+    hdr_ = nullptr;
+    bytes_ = 0;
+}
+
+uint32_t ShmFrameReader::slotCount() const
+{
+    return hdr_ ? hdr_->slotCount : 0;
+}
+
+uint64_t ShmFrameReader::published() const
+{
+    return hdr_ ? hdr_->published.load(memory_order_acquire) : 0;
+}
+
+bool ShmFrameReader::readSlot(uint64_t index, ShmFrame &out, bool withPixels)
+{
+    const SlotHeader *s = slotAt(base_, hdr_, index);
+    const uint64_t s1 = s->seq.load(memory_order_acquire);
+    if ((s1 & 1) || s1 != 2 * index + 2)
+        return false; // being written, or already reused for a later frame
+
+    out.seq = index;
+    out.frameId = s->frameId;
+    out.timestampNs = s->timestampNs;
+    out.width = s->width;
+    out.height = s->height;
+    out.cvType = s->cvType;
+    out.stride = s->stride;
+    out.annotated = s->annotated != 0;
+    int n = min(max(s->numDets, 0), kMaxDets);
+    out.dets.assign(s->dets, s->dets + n);
+    if (withPixels)
+    {
+        size_t bytes = (size_t)max(out.stride, 0) * max(out.height, 0);
+        if (bytes > hdr_->frameCapacity)
+            return false;
+        out.pixels.resize(bytes);
+        memcpy(out.pixels.data(), slotPixels(s), bytes);
+    }
+
+    atomic_thread_fence(memory_order_acquire);
+    return s->seq.load(memory_order_relaxed) == s1;
+}
+
+// Closed flag, or (at most every 100 ms) a different object behind the name
+bool ShmFrameReader::ringGone()
+{
+    if (__atomic_load_n(&hdr_->closed, __ATOMIC_ACQUIRE))
+        return true;
+    const auto now = chrono::steady_clock::now();
+    if (now < nextInodeCheck_)
+        return false;
+    nextInodeCheck_ = now + chrono::milliseconds(100);
+    int fd = shm_open(("/" + name_).c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return true;
+    struct stat st;
+    bool same = fstat(fd, &st) == 0 && st.st_dev == dev_ && st.st_ino == ino_;
+    ::close(fd);
+    return !same;
+}
+
+// Nothing to return right now: Closed only once the ring is gone and every
+// frame published before that has been offered
+ShmRead ShmFrameReader::idleStatus()
+{
+    if (!ringGone())
+        return ShmRead::Empty;
+    return published() > next_ ? ShmRead::Empty : ShmRead::Closed;
+}
+
+ShmRead ShmFrameReader::readLatest(ShmFrame &out, bool withPixels)
+{
+    if (!hdr_)
+        return ShmRead::Closed;
+    uint64_t pub = published();
+    if (pub == 0 || pub <= next_)
+        return idleStatus();
+    if (!readSlot(pub - 1, out, withPixels))
+        return ShmRead::Empty;
+    next_ = pub;
+    return ShmRead::Frame;
+}
+
+ShmRead ShmFrameReader::readNext(ShmFrame &out, bool withPixels)
+{
+    if (!hdr_)
+        return ShmRead::Closed;
+    uint64_t pub = published();
+    // The writer may be filling slot `pub`, which overwrites pub - slotCount;
+    // anything older than that window is gone.
+    uint64_t oldest = pub >= hdr_->slotCount ? pub - hdr_->slotCount + 1 : 0;
+    if (next_ < oldest)
+    {
+        dropped_ += oldest - next_;
+        next_ = oldest;
+    }
+    while (next_ < pub)
+    {
+        if (readSlot(next_, out, withPixels))
+        {
+            ++next_;
+            return ShmRead::Frame;
+        }
+        // Lapped while copying: skip it
+        ++next_;
+        ++dropped_;
+    }
+    return idleStatus();
+}
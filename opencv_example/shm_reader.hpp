@@ -0,0 +1,70 @@
+#pragma once
+
+#include "shm_ring.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+// ======================= Shared-memory ring reader =======================
+// Read-only attachment to a ring published by `main --shm <name>`. Does not
+// depend on OpenCV; `pixels` is packed rows of `cvType` (CV_8UC3 = BGR).
+struct ShmFrame
+{
+    uint64_t seq = 0; // publish index, contiguous across the ring
+    uint64_t frameId = 0;
+    int64_t timestampNs = 0;
+    int width = 0, height = 0, cvType = 0, stride = 0;
+    bool annotated = false;
+    std::vector<shmring::DetRecord> dets;
+    std::vector<uint8_t> pixels;
+};
+
+enum class ShmRead
+{
+    Frame,  // `out` holds a frame
+    Empty,  // nothing new yet
+    Closed, // the publisher closed or replaced the ring: close() and open() again
+};
+
+class ShmFrameReader
+{
+public:
+    ShmFrameReader() = default;
+    ~ShmFrameReader() { close(); }
+    ShmFrameReader(const ShmFrameReader &) = delete;
+    ShmFrameReader &operator=(const ShmFrameReader &) = delete;
+
+    // Attach to /dev/shm/<name>; false if it does not exist (yet) or is not a ring
+    bool open(const std::string &name);
+    void close();
+    bool isOpen() const { return base_ != nullptr; }
+
+    uint32_t slotCount() const;
+    uint64_t published() const;
+
+    // Newest complete frame not yet returned. Skips anything older.
+    ShmRead readLatest(ShmFrame &out, bool withPixels = true);
+    // Next frame in publish order; if the writer lapped us, jumps ahead and
+    // counts the frames lost in dropped().
+    ShmRead readNext(ShmFrame &out, bool withPixels = true);
+
+    uint64_t dropped() const { return dropped_; }
+
+private:
+    bool readSlot(uint64_t index, ShmFrame &out, bool withPixels);
+    ShmRead idleStatus();
+    bool ringGone();
+
+    std::string name_;
+    dev_t dev_ = 0;
+    ino_t ino_ = 0;
+    std::chrono::steady_clock::time_point nextInodeCheck_;
+    void *base_ = nullptr;
+    size_t bytes_ = 0;
+    const shmring::RingHeader *hdr_ = nullptr;
+    uint64_t next_ = 0; // next publish index to return
+    uint64_t dropped_ = 0;
+};
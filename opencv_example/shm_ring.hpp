@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// ======================= Shared-memory frame ring =======================
+// Layout shared by the publisher (main) and readers (shm_reader). One POSIX
+// shm object, /dev/shm/<name>:
+//
+//   RingHeader | Slot 0 (SlotHeader + pixels) | Slot 1 | ... | Slot n-1
+//
+// Single writer, any number of read-only readers. Each slot is a seqlock:
+// `seq` is odd while the writer is filling it, and 2*(publish index)+2 once
+// complete. Readers copy, then re-check `seq`; a mismatch means the writer
+// lapped them and the copy is discarded. Readers map the segment read-only
+// and never take a lock, so they cannot stall the writer.
+//
+// The publisher recreates the object on every start, so a reader's mapping
+// outlives it: `closed` is set when the publisher shuts down, and readers
+// also compare the inode behind the name to catch one that died without
+// closing. Either way the reader has to reattach.
+namespace shmring
+{
+constexpr uint32_t kMagic = 0x52485359; // "YSHR"
+constexpr uint32_t kVersion = 1;
+constexpr int kMaxDets = 256;
+constexpr size_t kAlign = 64;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shm ring needs lock-free 64-bit atomics");
+
+inline size_t alignUp(size_t n)
+{
+    return (n + kAlign - 1) & ~(kAlign - 1);
+}
+
+struct DetRecord
+{
+    int32_t x, y, w, h; // frame pixels
+    int32_t classId;
+    float score;
+};
+
+struct SlotHeader
+{
+    std::atomic<uint64_t> seq;
+    uint64_t frameId;      // frame counter of the detector loop
+    int64_t timestampNs;   // CLOCK_REALTIME at publish
+    int32_t width, height;
+    int32_t cvType;        // OpenCV type of the pixels (CV_8UC3 = 16)
+    int32_t stride;        // bytes per row, rows are packed
+    int32_t annotated;     // 1 if boxes/labels are drawn into the pixels
+    int32_t numDets;
+    DetRecord dets[kMaxDets];
+};
+
+struct RingHeader
+{
+    uint32_t magic;        // written last: readers wait for it
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t closed;       // 1 once the publisher closed this ring (atomic access)
+    uint64_t slotBytes;     // stride between slots
+    uint64_t frameCapacity; // max pixel bytes per slot
+    std::atomic<uint64_t> published; // frames published so far
+};
+
+inline size_t slotsOffset()
+{
+    return alignUp(sizeof(RingHeader));
+}
+
+inline size_t slotBytesFor(size_t frameCapacity)
+{
+    return alignUp(sizeof(SlotHeader)) + alignUp(frameCapacity);
+}
+
+inline size_t segmentBytes(uint32_t slotCount, size_t frameCapacity)
+{
+    return slotsOffset() + (size_t)slotCount * slotBytesFor(frameCapacity);
+}
+
+inline SlotHeader *slotAt(void *base, const RingHeader *h, uint64_t index)
+{
+    return reinterpret_cast<SlotHeader *>(static_cast<uint8_t *>(base) + slotsOffset() +
+                                          (index % h->slotCount) * h->slotBytes);
+}
+
+inline const SlotHeader *slotAt(const void *base, const RingHeader *h, uint64_t index)
+{
+    return slotAt(const_cast<void *>(base), h, index);
+}
+
+inline uint8_t *slotPixels(SlotHeader *s)
+{
+    return reinterpret_cast<uint8_t *>(s) + alignUp(sizeof(SlotHeader));
+}
+
+inline const uint8_t *slotPixels(const SlotHeader *s)
+{
+    return reinterpret_cast<const uint8_t *>(s) + alignUp(sizeof(SlotHeader));
+}
+} // namespace shmring
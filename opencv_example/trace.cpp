@@ -0,0 +1,171 @@
+#include "trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+namespace trace
+{
+    atomic<bool> g_enabled{false};
+
+    namespace
+    {
+        struct Event
+        {
+            const char *name;
+            int64_t startNs, endNs;
+            long frame;
+        };
+
+        // Written only by its owning thread. dump() copies it concurrently and
+        // throws away any slot the writer may have reused meanwhile.
+        struct ThreadRing
+        {
+            vector<Event> events;
+            atomic<uint64_t> head{0};
+            int tid = 0;
+            string name;
+        };
+
+        mutex g_registryMutex;
+        vector<shared_ptr<ThreadRing>> g_rings; // kept after threads exit
+        size_t g_capacity = 0;
+        int64_t g_originNs = 0;
+        volatile sig_atomic_t g_dumpRequest = 0;
+
+        thread_local ThreadRing *t_ring = nullptr;
+        thread_local const char *t_name = nullptr;
+        thread_local long t_frame = -1;
+
+        ThreadRing *registerThread()
+        {
+            auto r = make_shared<ThreadRing>();
+            r->events.resize(g_capacity);
+            lock_guard<mutex> lk(g_registryMutex);
+            r->tid = (int)g_rings.size() + 1;
+            r->name = t_name ? t_name : "thread " + to_string(r->tid);
+            g_rings.push_back(r);
+            t_ring = r.get();
+            return t_ring;
+        }
+
+        void jsonString(FILE *f, const string &s)
+        {
+            fputc('"', f);
+            for (char c : s)
+            {
+                if (c == '"' || c == '\\')
+                    fputc('\\', f);
+                if ((unsigned char)c >= 0x20)
+                    fputc(c, f);
+            }
+            fputc('"', f);
+        }
+    }
+
+    int64_t nowNs()
+    {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void enable(size_t eventsPerThread)
+    {
+        g_capacity = max<size_t>(eventsPerThread, 16);
+        g_originNs = nowNs();
+        g_enabled = true;
+    }
+
+    void setThreadName(const char *name)
+    {
+        t_name = name;
+        if (t_ring)
+        {
+            lock_guard<mutex> lk(g_registryMutex);
+            t_ring->name = name;
+        }
+    }
+
+    void setFrame(long frameId)
+    {
+        t_frame = frameId;
+    }
+
+    void record(const char *name, int64_t startNs, int64_t endNs)
+    {
+        ThreadRing *r = t_ring ? t_ring : registerThread();
+        uint64_t h = r->head.load(memory_order_relaxed);
+        r->events[h % r->events.size()] = Event{name, startNs, endNs, t_frame};
+        r->head.store(h + 1, memory_order_release);
+    }
+
+    bool dump(const string &path)
+    {
+        vector<shared_ptr<ThreadRing>> rings;
+        {
+            lock_guard<mutex> lk(g_registryMutex);
+            rings = g_rings;
+        }
+        FILE *f = fopen(path.c_str(), "w");
+        if (!f)
+            return false;
+
+        fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        bool first = true;
+        size_t total = 0;
+        for (const auto &r : rings)
+        {
+            string name;
+            {
+                lock_guard<mutex> lk(g_registryMutex);
+                name = r->name;
+            }
+            fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+                    first ? "" : ",\n", r->tid);
+            jsonString(f, name);
+            fprintf(f, "}}");
+            first = false;
+
+            const uint64_t cap = r->events.size();
+            const uint64_t h1 = r->head.load(memory_order_acquire);
+            const uint64_t begin = h1 > cap ? h1 - cap : 0;
+            vector<Event> copy(r->events.begin(), r->events.end());
+            const uint64_t h2 = r->head.load(memory_order_acquire);
+            // Anything up to h2 - cap may have been overwritten while copying
+            // (including the slot of a write still in progress at h2)
+            const uint64_t safe = max(begin, h2 + 1 > cap ? h2 + 1 - cap : 0);
+            for (uint64_t i = safe; i < h1; ++i)
+            {
+                const Event &e = copy[i % cap];
+                fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"yolo\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                           "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%ld}}",
+                        e.name, r->tid, (e.startNs - g_originNs) / 1e3, (e.endNs - e.startNs) / 1e3, e.frame);
+                ++total;
+            }
+        }
+        fprintf(f, "\n]}\n");
+        bool ok = !ferror(f);
+        fclose(f);
+        if (ok)
+            fprintf(stderr, "[trace] wrote %zu spans from %zu threads to %s\n", total, rings.size(), path.c_str());
+        return ok;
+    }
+
+    void requestDump()
+    {
+        g_dumpRequest = 1;
+    }
+
+    bool dumpRequested()
+    {
+        if (!g_dumpRequest)
+            return false;
+        g_dumpRequest = 0;
+        return true;
+    }
+}
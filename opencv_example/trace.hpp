@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// ======================= Span tracing =======================
+// TRACE_SPAN("forward") records one complete event from that line to the end
+// of the enclosing scope, tagged with the thread's current frame id. Events go
+// into a fixed-size ring owned by the recording thread (single writer, no
+// locks; oldest events are overwritten). trace::dump() writes everything
+// still in the rings as Chrome Trace Event JSON, loadable in chrome://tracing
+// or ui.perfetto.dev.
+//
+// Built only with -DYOLO_TRACE (CMake option, on by default). When built in
+// but not enabled at runtime, a span costs one relaxed atomic load.
+namespace trace
+{
+    extern std::atomic<bool> g_enabled;
+
+    inline bool enabled() { return g_enabled.load(std::memory_order_relaxed); }
+
+    // Start recording; each thread gets a ring of `eventsPerThread` spans
+    void enable(size_t eventsPerThread);
+    // Label the calling thread in the trace viewer
+    void setThreadName(const char *name);
+    // Frame id attached to spans subsequently recorded on this thread
+    void setFrame(long frameId);
+
+    // Write all recorded spans to `path`; safe while other threads record
+    bool dump(const std::string &path);
+
+    // Async-signal-safe; the main loop polls dumpRequested() and dumps
+    void requestDump();
+    bool dumpRequested(); // clears the request
+
+    int64_t nowNs();
+    void record(const char *name, int64_t startNs, int64_t endNs);
+
+    class Span
+    {
+    public:
+        explicit Span(const char *name) : name_(enabled() ? name : nullptr), start_(name_ ? nowNs() : 0) {}
+        ~Span()
+        {
+            if (name_)
+                record(name_, start_, nowNs());
+        }
+        Span(const Span &) = delete;
+        Span &operator=(const Span &) = delete;
+
+    private:
+        const char *name_; // must be a string literal (stored by pointer)
+        int64_t start_;
+    };
+}
+
+#ifdef YOLO_TRACE
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SPAN(name) trace::Span TRACE_CONCAT(traceSpan_, __LINE__)(name)
+#define TRACE_THREAD(name) trace::setThreadName(name)
+#define TRACE_FRAME(id) trace::setFrame(id)
+#else
+#define TRACE_SPAN(name) ((void)0)
+#define TRACE_THREAD(name) ((void)0)
+#define TRACE_FRAME(id) ((void)0)
+#endif
@@ -0,0 +1,104 @@
+#include "zones.hpp"
+
+#include <opencv2/imgproc.hpp>
+
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+
+using namespace cv;
+using namespace std;
+
+void ZoneSet::load(const string &path)
+{
+    ifstream ifs(path);
+    if (!ifs.is_open())
+        throw runtime_error("Could not open zones file: " + path);
+
+    zones_.clear();
+    string l;
+    while (getline(ifs, l))
+    {
+        size_t b = l.find_first_not_of(" \t\r");
+        if (b == string::npos || l[b] == '#')
+            continue;
+        size_t colon = l.find(':', b);
+        if (colon == string::npos)
+            continue;
+
+        Zone z;
+        z.name = l.substr(b, colon - b);
+        vector<float> v;
+        const char *p = l.c_str() + colon + 1;
+        while (*p && *p != '#')
+        {
+            if (isdigit((unsigned char)*p) || ((*p == '-' || *p == '.') && isdigit((unsigned char)p[1])))
+            {
+                char *end = nullptr;
+                v.push_back(strtof(p, &end));
+                p = end;
+            }
+            else
+                ++p;
+        }
+        if (v.empty())
+            continue; // "zones:" header or other key
+        if (v.size() % 2 || v.size() < 6)
+            throw runtime_error("Zone '" + z.name + "' needs at least 3 x,y points in " + path);
+
+        z.normalized = true;
+        for (size_t i = 0; i < v.size(); i += 2)
+        {
+            z.pts.push_back(Point2f(v[i], v[i + 1]));
+            z.normalized = z.normalized && v[i] <= 1.f && v[i + 1] <= 1.f;
+        }
+        zones_.push_back(z);
+    }
+    if (zones_.empty())
+        throw runtime_error("No zones found in " + path);
+    resolvedFor_ = Size();
+}
+
+void ZoneSet::resolve(Size frameSize)
+{
+    if (frameSize == resolvedFor_)
+        return;
+    resolvedFor_ = frameSize;
+    polys_.clear();
+    rects_.clear();
+    const Rect frameRect(0, 0, frameSize.width, frameSize.height);
+    for (const Zone &z : zones_)
+    {
+        vector<Point> poly;
+        for (const Point2f &p : z.pts)
+        {
+            float x = z.normalized ? p.x * frameSize.width : p.x;
+            float y = z.normalized ? p.y * frameSize.height : p.y;
+            poly.push_back(Point(cvRound(x), cvRound(y)));
+        }
+        polys_.push_back(poly);
+        rects_.push_back(boundingRect(poly) & frameRect);
+    }
+}
+
+Rect ZoneSet::unionRect() const
+{
+    Rect u;
+    for (const Rect &r : rects_)
+        u = u.empty() ? r : (u | r);
+    return u;
+}
+
+bool ZoneSet::contains(const Rect &box) const
+{
+    Point2f foot(box.x + box.width * 0.5f, (float)(box.y + box.height - 1));
+    for (const auto &poly : polys_)
+        if (pointPolygonTest(poly, foot, false) >= 0)
+            return true;
+    return false;
+}
+
+void ZoneSet::draw(Mat &frame) const
+{
+    polylines(frame, polys_, true, Scalar(0, 255, 255), 1, LINE_AA);
+}
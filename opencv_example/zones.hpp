@@ -0,0 +1,45 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <string>
+#include <vector>
+
+// ======================= ROI zones =======================
+// Polygons loaded from a small yaml-like file:
+//
+//   zones:
+//     door: [120,80, 520,80, 520,700, 120,700]
+//     lane: [0.55,0.30, 1.0,0.30, 1.0,1.0, 0.40,1.0]
+//
+// Coordinates are frame pixels, or fractions of the frame when every value
+// of a zone is <= 1. A detection belongs to a zone when the bottom-centre of
+// its box (where the object meets the ground) lies inside the polygon.
+class ZoneSet
+{
+public:
+    void load(const std::string &path); // throws on error
+    bool empty() const { return zones_.empty(); }
+    size_t size() const { return zones_.size(); }
+    const std::string &name(size_t i) const { return zones_[i].name; }
+
+    // Pixel polygons/rects for this frame size (recomputed only on change)
+    void resolve(cv::Size frameSize);
+    const std::vector<cv::Rect> &rects() const { return rects_; }
+    cv::Rect unionRect() const;
+
+    bool contains(const cv::Rect &box) const;
+    void draw(cv::Mat &frame) const;
+
+private:
+    struct Zone
+    {
+        std::string name;
+        std::vector<cv::Point2f> pts;
+        bool normalized = false;
+    };
+    std::vector<Zone> zones_;
+    cv::Size resolvedFor_;
+    std::vector<std::vector<cv::Point>> polys_;
+    std::vector<cv::Rect> rects_;
+};